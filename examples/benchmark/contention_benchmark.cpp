@@ -0,0 +1,111 @@
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <trftp/server/server.h>
+
+namespace
+{
+
+constexpr std::uint16_t SINK_PORT = 50998;
+constexpr std::size_t PACKET_SIZE = sizeof(trftp::TrftpHeader) + TRFTP_PAYLOAD_SIZE;
+
+double ProcessCpuSeconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs one sender thread per transfer, all sharing the same socket like the DATA threads of a Server
+void Run(const std::string &name, std::size_t transfers, std::size_t packets_per_transfer,
+         const std::function<void(std::size_t)> &transfer)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(transfers);
+
+    const auto cpu_begin = ProcessCpuSeconds();
+    const auto wall_begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < transfers; i++)
+    {
+        threads.emplace_back(transfer, packets_per_transfer);
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wall_begin;
+    const auto cpu = ProcessCpuSeconds() - cpu_begin;
+
+    const auto packets = transfers * packets_per_transfer;
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(14) << packets / wall.count() << " pkt/s" << std::setw(14) << packets / cpu
+              << " pkt/s/core" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " [transfers] [packets_per_transfer]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto transfers = (argc > 1) ? std::stoul(argv[1]) : 64UL;
+    const auto packets_per_transfer = (argc > 2) ? std::stoul(argv[2]) : 20'000UL;
+
+    // The sink never reads, so the kernel drops whatever does not fit into its receive buffer
+    trftp::UdpSocket sink(SINK_PORT);
+    trftp::UdpSocket sender;
+
+    const sockaddr_in sink_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htobe16(SINK_PORT),
+        .sin_addr = { .s_addr = htobe32(INADDR_LOOPBACK) },
+    };
+
+    std::cout << transfers << " concurrent transfers x " << packets_per_transfer << " DATA packets ("
+              << PACKET_SIZE << " bytes) over one shared socket" << std::endl;
+
+    // 1. Every sendto() serialized on one lock, as the socket used to do
+    std::mutex send_mutex;
+    Run("Send (serialized)", transfers, packets_per_transfer, [&](std::size_t packets) {
+        trftp::TrftpMessage msg = {};
+        for (std::size_t i = 0; i < packets; i++)
+        {
+            std::scoped_lock lock(send_mutex);
+            sender.Send(msg, PACKET_SIZE, sink_addr);
+        }
+    });
+
+    // 2. Concurrent sendto() calls
+    Run("Send", transfers, packets_per_transfer, [&](std::size_t packets) {
+        trftp::TrftpMessage msg = {};
+        for (std::size_t i = 0; i < packets; i++)
+        {
+            sender.Send(msg, PACKET_SIZE, sink_addr);
+        }
+    });
+
+    // 3. Concurrent bursts, one UDP_SEGMENT (GSO) super-buffer or sendmmsg() each
+    const auto segmented = sender.SetSegmentOffload(true);
+    Run(std::string(segmented ? "SendSegmented/" : "SendBatch/") + std::to_string(TRAN_BURST_SIZE), transfers,
+        packets_per_transfer, [&](std::size_t packets) {
+            std::vector<trftp::TrftpMessage> msgs(TRAN_BURST_SIZE);
+            std::vector<std::size_t> lens(TRAN_BURST_SIZE, PACKET_SIZE);
+            for (std::size_t i = 0; i < packets; i += TRAN_BURST_SIZE)
+            {
+                sender.SendSegmented(msgs.data(), lens.data(), std::min<std::size_t>(TRAN_BURST_SIZE, packets - i),
+                                     sink_addr);
+            }
+        });
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <trftp/server/server.h>
+
+namespace
+{
+
+constexpr std::uint16_t SINK_PORT = 50999;
+
+double ThreadCpuSeconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void PrintResult(const std::string &name, std::size_t packets, double wall_sec, double cpu_sec)
+{
+    std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(0) << std::setw(14)
+              << packets / wall_sec << " pkt/s" << std::setw(14) << packets / cpu_sec << " pkt/s/core" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " [packet_count] [burst_size] [payload_size]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto packet_count = (argc > 1) ? std::stoul(argv[1]) : 1'000'000UL;
+    const auto burst_size = (argc > 2) ? std::stoul(argv[2]) : static_cast<unsigned long>(TRAN_BURST_SIZE);
+    const auto payload_size = (argc > 3) ? std::stoul(argv[3]) : static_cast<unsigned long>(TRFTP_PAYLOAD_SIZE);
+    if (payload_size > TRFTP_MAX_PAYLOAD_SIZE)
+    {
+        std::cerr << "Payload size must not exceed " << TRFTP_MAX_PAYLOAD_SIZE << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // The sink never reads, so the kernel drops whatever does not fit into its receive buffer
+    trftp::UdpSocket sink(SINK_PORT);
+    trftp::UdpSocket sender;
+
+    const sockaddr_in sink_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htobe16(SINK_PORT),
+        .sin_addr = { .s_addr = htobe32(INADDR_LOOPBACK) },
+    };
+
+    std::vector<trftp::TrftpMessage> msgs(burst_size);
+    std::vector<std::size_t> lens(burst_size, sizeof(trftp::TrftpHeader) + payload_size);
+
+    std::cout << "Sending " << packet_count << " DATA packets (" << lens[0]
+              << " bytes) over loopback" << std::endl;
+
+    // 1. One sendto() per packet
+    auto cpu_begin = ThreadCpuSeconds();
+    auto wall_begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < packet_count; i++)
+    {
+        sender.Send(msgs[i % burst_size], lens[i % burst_size], sink_addr);
+    }
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wall_begin;
+    PrintResult("Send", packet_count, wall.count(), ThreadCpuSeconds() - cpu_begin);
+
+    // 2. One sendmmsg() per burst
+    cpu_begin = ThreadCpuSeconds();
+    wall_begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < packet_count; i += burst_size)
+    {
+        sender.SendBatch(msgs.data(), lens.data(), std::min(burst_size, packet_count - i), sink_addr);
+    }
+    wall = std::chrono::steady_clock::now() - wall_begin;
+    PrintResult("SendBatch/" + std::to_string(burst_size), packet_count, wall.count(), ThreadCpuSeconds() - cpu_begin);
+
+    // 3. One io_uring_enter() per burst
+    if (sender.SetIoBackend(trftp::IoBackend::IO_URING))
+    {
+        cpu_begin = ThreadCpuSeconds();
+        wall_begin = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < packet_count; i += burst_size)
+        {
+            sender.SendBatch(msgs.data(), lens.data(), std::min(burst_size, packet_count - i), sink_addr);
+        }
+        wall = std::chrono::steady_clock::now() - wall_begin;
+        PrintResult("io_uring/" + std::to_string(burst_size), packet_count, wall.count(),
+                    ThreadCpuSeconds() - cpu_begin);
+        sender.SetIoBackend(trftp::IoBackend::BLOCKING);
+    }
+    else
+    {
+        std::cout << "io_uring: not available (build with TRFTP_WITH_IO_URING=ON)" << std::endl;
+    }
+
+    // 4. One UDP_SEGMENT (GSO) super-buffer per burst
+    if (!sender.SetSegmentOffload(true))
+    {
+        std::cout << "SendSegmented: UDP_SEGMENT is not supported by the kernel" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    cpu_begin = ThreadCpuSeconds();
+    wall_begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < packet_count; i += burst_size)
+    {
+        sender.SendSegmented(msgs.data(), lens.data(), std::min(burst_size, packet_count - i), sink_addr);
+    }
+    wall = std::chrono::steady_clock::now() - wall_begin;
+    PrintResult("SendSegmented/" + std::to_string(burst_size), packet_count, wall.count(),
+                ThreadCpuSeconds() - cpu_begin);
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include <condition_variable>
+#include <fcntl.h>
+#include <filesystem>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+
+#include <trftp/client/client.h>
+#include <trftp/server/server.h>
+
+namespace
+{
+
+constexpr std::uint16_t SERVER_PORT = 50998;
+constexpr std::uint16_t CLIENT_PORT = 50997;
+
+constexpr std::uint64_t FOUR_GIB = 1ULL << 32;
+constexpr std::uint64_t FILE_SIZE = FOUR_GIB + 12345; // Just past what 32 bits can hold
+constexpr char MARKER[] = "trftp-large-file";
+
+// Everything but the markers is a hole, so the file takes next to no disk space. The markers sit where a 32-bit
+// length or offset would wrap: either side of the 4 GiB boundary, across it, and at both ends.
+bool WriteSparseFile(const std::filesystem::path &path)
+{
+    const int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool ok = ftruncate(fd, FILE_SIZE) == 0;
+    for (std::uint64_t offset : std::initializer_list<std::uint64_t>{
+             0, FOUR_GIB - sizeof(MARKER), FOUR_GIB - sizeof(MARKER) / 2, FOUR_GIB, FILE_SIZE - sizeof(MARKER) })
+    {
+        ok = ok && (pwrite(fd, MARKER, sizeof(MARKER), offset) == sizeof(MARKER));
+    }
+
+    return (close(fd) == 0) && ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " [work_dir]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::filesystem::path work_dir = (argc > 1) ? argv[1] : std::filesystem::temp_directory_path();
+    const auto src_path = work_dir / "trftp_large_src.bin";
+    const auto dst_path = work_dir / "trftp_large_dst.bin";
+
+    if (!WriteSparseFile(src_path))
+    {
+        std::cerr << "Cannot write " << src_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::filesystem::remove(dst_path);
+
+    trftp::Client client(CLIENT_PORT);
+    client.SetDestinationPath(dst_path);
+    client.SetPayloadSize(TRFTP_MAX_PAYLOAD_SIZE);
+
+    std::condition_variable cv;
+    std::mutex m;
+    bool received = false;
+    client.AttachFileHandler([&](const std::string &, const std::uint32_t) {
+        std::scoped_lock lock(m);
+        received = true;
+        cv.notify_one();
+    });
+
+    trftp::Server server(SERVER_PORT);
+    server.SetPayloadSize(TRFTP_MAX_PAYLOAD_SIZE);
+
+    std::cout << "Sending " << FILE_SIZE << " bytes over loopback" << std::endl;
+    const auto begin = std::chrono::steady_clock::now();
+    const auto status = server.StartFileTransfer("127.0.0.1:" + std::to_string(CLIENT_PORT), src_path, 1);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    std::cout << "Transfer: " << trftp::FtpStatusToString(status) << " after " << elapsed.count() << " s" << std::endl;
+
+    if (std::unique_lock lock(m); !cv.wait_for(lock, std::chrono::seconds(30), [&]() { return received; }))
+    {
+        std::cerr << "Timeout" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto dst_size = std::filesystem::file_size(dst_path);
+    const auto src_crc32 = trftp::CalculateFileCrc32(src_path);
+    const auto dst_crc32 = trftp::CalculateFileCrc32(dst_path);
+    std::cout << "Size: " << dst_size << " (expected " << FILE_SIZE << "), CRC32: " << std::hex << dst_crc32
+              << " (expected " << src_crc32 << ")" << std::dec << std::endl;
+
+    std::filesystem::remove(src_path);
+    std::filesystem::remove(dst_path);
+
+    return ((status == trftp::FtpStatus::FIN) && (dst_size == FILE_SIZE) && (dst_crc32 == src_crc32)) ? EXIT_SUCCESS
+                                                                                                     : EXIT_FAILURE;
+}
@@ -22,15 +22,14 @@ int main(int argc, char **argv)
     }
 
     trftp::Client client(port);
+    client.SetDestinationPath("trftp_file");
     std::cout << "Waiting for file transfer..." << std::endl;
 
     std::condition_variable cv;
     std::mutex m;
 
     client.AttachFileHandler([&cv](const std::string &file_path, const std::uint32_t version) {
-        std::filesystem::path rx_path = "trftp_file";
-        std::filesystem::rename(file_path, rx_path);
-        std::cout << "File received: " << rx_path << " (version: " << version << ")" << std::endl;
+        std::cout << "File received: " << file_path << " (version: " << version << ")" << std::endl;
         cv.notify_one();
     });
 
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "trftp/client/file_sink.h"
+#include "trftp/common.h"
+#include "trftp/util.h"
+
+namespace trftp
+{
+
+#define BUNDLE_EXTRACT_CHUNK_SIZE (64U * 1024U) // Bytes of a file copied out of the stream at a time
+
+/**
+ * Extracts the files of a directory's DATA stream on a thread of its own, each as soon as the stream holds all of it
+ * and its CRC32 in order, so a file is complete (checked and in place) while the ones behind it are still being
+ * received.
+ * The stream is read back from the file it is received into, after the receive thread has flushed it there.
+ */
+class BundleExtractor
+{
+public:
+    explicit BundleExtractor();
+    ~BundleExtractor();
+    BundleExtractor(const BundleExtractor &) = delete;
+    BundleExtractor &operator=(const BundleExtractor &) = delete;
+
+    bool Start(const std::filesystem::path &stream_path, std::uint64_t stream_length, std::uint32_t file_count,
+               std::uint32_t manifest_crc32, const std::filesystem::path &dir_path);
+    void Advance(std::uint64_t received_length); // Every stream byte below it has been received and flushed
+    bool Finish(); // Waits for the whole stream, true if every file of the manifest was extracted intact
+    void Stop();
+    std::vector<std::filesystem::path> TakeExtracted(); // Files put in place since the last call
+
+private:
+    struct Entry
+    {
+        std::filesystem::path path; // Relative to the directory
+        std::uint64_t file_length;  // Followed by its CRC32 in the stream
+    };
+
+    void Run();
+    bool WaitReceived(std::uint64_t length);
+    bool ReadManifest(std::vector<Entry> &entries, std::uint64_t &length);
+    bool ExtractFile(const Entry &entry, std::uint64_t offset);
+    bool ReadStream(std::uint64_t offset, void *buf, std::size_t len) const;
+
+    int fd_;
+    std::uint64_t stream_length_;
+    std::uint32_t file_count_;
+    std::uint32_t manifest_crc32_;
+    std::filesystem::path dir_path_;
+    bool succeeded_; // Set by the thread once every file is extracted
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::thread thr_;
+    std::uint64_t received_length_;                // Guarded by mtx_
+    bool stopping_;                                // Guarded by mtx_
+    std::vector<std::filesystem::path> extracted_; // Guarded by mtx_
+};
+
+} // namespace trftp
@@ -6,6 +6,7 @@
 
 #include "trftp/client/client_transaction.h"
 #include "trftp/common.h"
+#include "trftp/reactor.h"
 #include "trftp/thread_safe_log.h"
 #include "trftp/udp_socket.h"
 
@@ -22,6 +23,16 @@ public:
 
     void AttachFileHandler(FileHandler callback);
     void DetachFileHandler();
+    void SetDestinationPath(const std::filesystem::path &file_path);
+    bool SetReceiveOffload(bool enable);
+    bool SetIoBackend(IoBackend backend);
+    bool SetPayloadSize(std::uint32_t payload_size);
+    bool SetReceiveBuffer(std::size_t bytes);
+    bool SetTimestamping(Timestamping mode);
+    bool SetForwardErrorCorrection(std::uint32_t block_size);
+    void SetResumable(bool enable);
+    void SetCompression(bool enable);
+    bool JoinGroup(const std::string &group_uri, const std::string &interface_ip = "0.0.0.0");
 
     void OnFileReceived(const std::string &file_path, const std::uint32_t version) const;
 
@@ -29,11 +40,11 @@ private:
     void HandleIncomingMessages();
 
     UdpSocket udp_socket_;
-    std::atomic_bool is_running_;
-    std::thread thread_;
+    Reactor reactor_; // Drives both the client and the transaction socket
     std::unique_ptr<FileHandler> file_handler_;
 
     ClientTransaction transaction_;
+    std::thread thread_;
 };
 
 } // namespace trftp
\ No newline at end of file
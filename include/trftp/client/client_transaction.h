@@ -1,14 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "trftp/client/bundle_extractor.h"
+#include "trftp/client/decompressor.h"
+#include "trftp/client/file_sink.h"
 #include "trftp/common.h"
+#include "trftp/reactor.h"
+#include "trftp/rtt_estimator.h"
 #include "trftp/thread_safe_log.h"
 #include "trftp/udp_socket.h"
 #include "trftp/util.h"
@@ -18,24 +29,66 @@ namespace trftp
 
 using namespace std::chrono_literals;
 
+#define RECV_BATCH_SIZE (32U) // Messages per ReceiveBatch() call
+#define RECV_TIMEOUT    (3s)  // Cancel when the server stays silent this long
+#define RECV_TIMEOUT_MAX (30s) // Longest silence tolerated on slow paths, which stretch RECV_TIMEOUT by their RTO
+#define RECV_BUFFER_LATENCY (20ms) // Stall of the receive thread the socket buffer absorbs at the rate DATA arrives at
+#define RECV_BUFFER_MAX (16U << 20) // Bytes, largest receive buffer sized automatically
+#define RECV_SACK_TIMEOUT   (50ms) // Silence after which every missing DATA packet is reported again
+#define RECV_REORDER_DISTANCE (3U) // Holes this close to the highest PSN may still be filled by reordered packets
+#define RECV_RESUME_MAGIC (0x52534D32) // RSM2, starts the state file kept next to a suspended transfer
+#define RECV_DELTA_CHUNK_SIZE (64U * 1024U) // Bytes copied at a time when rebuilding a file from a delta
+
 class Client;
 
 class ClientTransaction
 {
 public:
-    explicit ClientTransaction(Client *client, std::uint32_t file_version);
+    explicit ClientTransaction(Client *client, Reactor &reactor, std::uint32_t file_version);
     ~ClientTransaction();
     ClientTransaction(const ClientTransaction &) = delete;
     ClientTransaction &operator=(const ClientTransaction &) = delete;
 
     bool IsAlive() const;
-    void Begin(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr);
+    void SetDestinationPath(const std::filesystem::path &file_path);
+    bool SetReceiveOffload(bool enable);
+    bool SetIoBackend(IoBackend backend);
+    bool SetPayloadSize(std::uint32_t payload_size);
+    bool SetReceiveBuffer(std::size_t bytes);
+    bool SetTimestamping(Timestamping mode);
+    bool SetForwardErrorCorrection(std::uint32_t block_size);
+    void SetResumable(bool enable);
+    void SetCompression(bool enable);
+    bool JoinGroup(const sockaddr_in &group, const in_addr &interface); // Port must differ from the client's own
+    void Begin(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr, bool multicast = false);
+    bool ReceiveAhead(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr); // DATA to the client's port
 
 private:
     void Reset();
     void HandleIncomingMessages();
-    void OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr);
+    void HandleGroupMessages();
+    void CompleteBatch(std::size_t count);
+    void GrowReceiveBuffer(std::uint64_t packets);
+    void OnTimeout();
+    void OnSackTimeout();
+    void ReportProgress(bool silent);
+    void ReportExtractedFiles();
+    void OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr, Timestamp rx_time = {});
+    void ReceiveInfo(const TrftpInfo &info, std::size_t payload_len, const sockaddr_in &addr, Timestamp rx_time);
+    void MarkReceived(std::uint32_t psn);
+    bool UpdateFecBlock(std::uint32_t psn, const std::uint8_t *payload, std::size_t len, bool is_parity);
+    void FinishTransfer();
+    void SuspendTransfer();
+    bool LoadResumeState(std::vector<bool> &received_psns);
+    void RestoreReceived(std::vector<bool> &&received_psns);
+    bool ApplyDelta();
+    FileSink &DataSink();
+    UdpSocket &DataSocket();
+    std::filesystem::path StreamPath() const;
+    std::filesystem::path ResumeStatePath() const;
     void SendMessage(MessageId id);
+    std::chrono::microseconds ReceiveTimeout() const;
+    std::chrono::microseconds SackTimeout() const;
     bool ValidateMessageIntegrity(const TrftpMessage &msg, std::size_t len) const;
 
     void PrintRecvLog(const TrftpMessage &msg) const;
@@ -44,22 +97,89 @@ private:
     Client *client_;
 
     std::uint32_t cur_file_version_;
+    std::uint32_t cur_file_crc32_; // Of the file received last, 0 until then
+    bool delta_rejected_;          // A delta did not rebuild the file we hold, take whole files until the next one
     std::chrono::microseconds inter_packet_gap_;
 
     std::atomic_bool is_active_;
     std::atomic<FtpStatus> status_;
     sockaddr_in server_address_;
     UdpSocket udp_socket_;
-    std::thread thread_;
+    std::unique_ptr<UdpSocket> group_socket_; // Bound to the multicast group joined, if any
+    bool multicast_;                          // The transfer was announced to the group, DATA arrives there
+    bool fast_handshake_;                     // NTF carried INFO and was answered with RDY
+    bool speculative_data_;                   // DATA the server sent ahead of RDY is taken
+    Reactor &reactor_;
+    int timeout_timer_;
+    int sack_timer_;
+
+    std::uint32_t max_payload_size_;                    // Largest DATA payload accepted from the server
+    std::uint32_t payload_size_;                        // Agreed in RDY
+    bool legacy_server_;                                // INFO carried no payload size, reply with the old RDY/RTX
+    std::uint32_t server_features_;                     // TRFTP_FEATURE_* offered in INFO
+    std::size_t receive_buffer_size_;                   // SO_RCVBUF, 0 derives it from the payload size and rate
+    std::uint64_t receive_buffer_packets_;              // Of the derived SO_RCVBUF, 0 if configured, max once capped
+    std::chrono::steady_clock::time_point rate_start_;  // Since when rate_packets_ have been received
+    std::uint64_t rate_packets_;                        // Messages received since rate_start_
+    std::uint32_t receive_drops_base_;                  // Kernel drop counter when the transfer started
+    Timestamp request_sent_time_;                       // TX time of the last CHK or RDY (zero without timestamping)
+    RttEstimator rtt_;                                  // Sampled by CHK -> INFO and RDY -> first DATA
+    std::uint32_t total_packet_number_;                 // (file-length / payload-size) [+1]
+    std::atomic<std::uint32_t> packet_sequence_number_; // [0..(tpn-1)], every PSN below it has been received
+
+    // With SACK, DATA is accepted out of order within the receive window and only the holes are requested again
+    bool selective_ack_;                                // INFO offered TRFTP_FEATURE_SACK
+    std::uint32_t receive_window_;                      // DATA packets accepted past packet_sequence_number_
+    std::vector<bool> received_psns_;                   // Indexed by PSN
+    std::uint32_t highest_psn_;                         // One past the highest PSN received
+    std::uint32_t sack_reported_psn_;                   // Holes below it have been reported already
+    std::uint32_t sack_acked_psn_;                      // packet_sequence_number_ sent in the last SACK
+    std::uint32_t sack_from_psn_;                       // Range of holes the next SACK reports
+    std::uint32_t sack_end_psn_;
+
+    // With FEC, the XOR parity following every block of DATA rebuilds one lost packet of the block without a SACK
+    struct FecBlock
+    {
+        std::vector<std::uint8_t> parity; // XOR of the block's DATA received so far and of its FEC packet
+        std::uint32_t received;           // DATA packets of the block received
+        bool has_parity;                  // FEC packet received
+    };
+    std::uint32_t max_fec_block_size_;                       // Set by SetForwardErrorCorrection(), 0 disables FEC
+    std::uint32_t fec_block_size_;                           // Agreed in RDY
+    std::unordered_map<std::uint32_t, FecBlock> fec_blocks_; // Incomplete blocks by their first PSN
+
+    // A cancelled transfer keeps its temporary file and the PSNs it holds, so the next one of the same file resumes
+    struct ResumeState
+    {
+        std::uint32_t magic;               // RECV_RESUME_MAGIC
+        std::uint32_t new_file_version;    // The file the PSNs belong to
+        std::uint64_t file_length;
+        std::uint32_t crc32;
+        std::uint32_t payload_size;        // The PSNs are only valid at this payload size
+        std::uint32_t total_packet_number; // Followed by one bit per PSN (LSB first), set when it was received
+    };
+    bool resumable_;           // Set by SetResumable()
+    std::uint32_t resume_psn_; // Sent in RDY, every PSN below it is held already
+
+    // With a delta or compression, DATA is written to a stream file of its own. The new file is rebuilt from a delta
+    // and the current one at the end, and decompressed from the stream while it is received.
+    std::uint32_t delta_length_;      // Agreed in RDY, 0 receives the whole file
+    bool compression_;                // Set by SetCompression(), compressed files are taken when offered
+    std::uint32_t compressed_length_; // Agreed in RDY, 0 receives the file as it is
+    std::uint64_t data_length_;       // Bytes carried by DATA, the file, its delta or the compressed file
+    FileSink stream_sink_;
+    Decompressor decompressor_;
+
+    // A directory is received as one stream too, each of its files is put in place as soon as the stream holds it
+    std::uint32_t bundle_files_; // From INFO message, 0 receives a single file
+    BundleExtractor bundle_extractor_;
 
-    std::uint32_t total_packet_number_;                 // (file-length / 1408) [+1]
-    std::atomic<std::uint32_t> packet_sequence_number_; // [0..(tpn-1)]
-    std::ofstream new_file_stream_;
-    std::filesystem::path new_file_path_;
+    FileSink new_file_sink_;
+    std::filesystem::path new_file_path_; // Destination chosen by the caller, the directory's root for a directory
 
     // Data informed from the server
     std::uint32_t new_file_version_; // From NTF message
-    std::uint32_t new_file_size_;    // From INFO message
+    std::uint64_t new_file_size_;    // From INFO message
     std::uint32_t new_file_crc32_;   // From INFO message
 };
 
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "trftp/client/file_sink.h"
+#include "trftp/common.h"
+#include "trftp/compression.h"
+
+namespace trftp
+{
+
+/**
+ * Decompresses a compressed DATA stream into the destination file on a thread of its own, block by block as the
+ * stream is received in order, so the receive thread never waits for it.
+ * The stream is read back from the file it is received into, after the receive thread has flushed it there.
+ */
+class Decompressor
+{
+public:
+    explicit Decompressor();
+    ~Decompressor();
+    Decompressor(const Decompressor &) = delete;
+    Decompressor &operator=(const Decompressor &) = delete;
+
+    // The sink is written only by the decompressor thread until Finish() or Stop() returns
+    bool Start(const std::filesystem::path &stream_path, std::uint64_t stream_length, FileSink &sink,
+               std::uint64_t raw_length);
+    void Advance(std::uint64_t received_length); // Every stream byte below it has been received and flushed
+    bool Finish(); // Waits for the whole stream, true if it decompressed to exactly raw_length bytes
+    void Stop();
+
+private:
+    void Run();
+    bool ReadStream(std::uint64_t offset, void *buf, std::size_t len) const;
+
+    int fd_;
+    FileSink *sink_;
+    std::uint64_t stream_length_;
+    std::uint64_t raw_length_;
+    bool succeeded_; // Set by the thread once the stream is decompressed
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::thread thr_;
+    std::uint64_t received_length_; // Guarded by mtx_
+    bool stopping_;                 // Guarded by mtx_
+};
+
+} // namespace trftp
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "trftp/io_uring.h"
+#include "trftp/util.h"
+
+namespace trftp
+{
+
+#define SINK_READ_CHUNK_SIZE (1U << 20) // Bytes of the file read at a time by Checksum()
+#define SINK_READ_AHEAD (8U)            // Chunks Checksum() has in flight at once with the io_uring backend
+
+/**
+ * Random-access, preallocated destination for a received file.
+ * Data is written to a temporary file next to the final path and renamed over it on Commit().
+ * Suspend() keeps the temporary file instead, so a later Open() with resume set continues writing into it.
+ * With the io_uring backend, writes are queued and submitted together on Flush(), so the written
+ * buffers must stay valid until then. Checksum() reads the file back SINK_READ_AHEAD chunks at a time.
+ */
+class FileSink
+{
+public:
+    explicit FileSink();
+    ~FileSink();
+    FileSink(const FileSink &) = delete;
+    FileSink &operator=(const FileSink &) = delete;
+
+    bool Open(const std::filesystem::path &file_path, std::uint64_t file_size, bool resume = false);
+    bool Write(std::uint64_t offset, const void *data, std::size_t len);
+    bool Flush();
+    bool Checksum(std::uint32_t &crc32); // CRC32 of the whole file as written so far
+    bool Commit();
+    bool Suspend();
+    void Discard();
+
+    bool SetIoBackend(IoBackend backend);
+    bool IsOpen() const;
+    const std::filesystem::path &TempPath() const;
+
+private:
+    int fd_;
+    std::filesystem::path file_path_; // Final destination
+    std::filesystem::path temp_path_; // Same directory as the destination, so the rename never copies
+
+    struct PendingWrite
+    {
+        std::uint64_t offset;
+        const void *data;
+        std::size_t len;
+    };
+    std::unique_ptr<IoUring> ring_;            // Set when IoBackend::IO_URING is selected
+    std::vector<PendingWrite> pending_writes_; // Queued on the ring until the next Flush()
+};
+
+} // namespace trftp
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace trftp
@@ -7,6 +8,34 @@ namespace trftp
 
 #define TRFTP_MAGIC (0x524F424C) // ROBL
 
+#define TRFTP_PAYLOAD_SIZE     (1408U) // Default DATA payload, fills a 1500-byte MTU
+#define TRFTP_MIN_PAYLOAD_SIZE (512U)  // Smallest DATA payload that may be negotiated
+#define TRFTP_MAX_PAYLOAD_SIZE (8940U) // DATA payload filling a 9000-byte MTU
+#define TRFTP_PACKET_OVERHEAD  (60U)   // IPv4 (20) + UDP (8) + TRFTP (32) headers
+
+#define TRFTP_FEATURE_SACK        (1U << 0) // Missing DATA is reported with SACK instead of a go-back-N RTX
+#define TRFTP_FEATURE_FEC         (1U << 1) // An XOR parity packet may follow every block of DATA, requires SACK
+#define TRFTP_FEATURE_RESUME      (1U << 2) // DATA may start past PSN 0 when the client holds part of the file
+#define TRFTP_FEATURE_DELTA       (1U << 3) // DATA may carry a delta against the client's current version instead
+#define TRFTP_FEATURE_COMPRESSION (1U << 4) // DATA may carry the file compressed block by block
+#define TRFTP_FEATURE_MULTICAST   (1U << 5) // DATA goes to a multicast group at the offered payload size, as it is
+#define TRFTP_FEATURE_BUNDLE      (1U << 6) // DATA carries the files of a directory after their manifest
+#define TRFTP_FEATURE_LARGE_FILE  (1U << 7) // INFO, RDY and DONE carry the file length in 64 bits as well
+#define TRFTP_FEATURE_HELD_PSNS   (1U << 8) // DATA skips the PSNs a resuming client lists in RDY as held
+
+#define TRFTP_LENGTH_LARGE (0xFFFF'FFFFULL) // 32-bit file length of a file this large or larger, see large_file_length
+
+#define TRFTP_SACK_BITMAP_SIZE (480U) // Bytes, so a SACK still fits in the smallest payload, and of RDY's held PSNs
+
+#define TRFTP_FEC_MIN_BLOCK_SIZE (2U)   // DATA packets per parity packet, i.e. 50% redundancy
+#define TRFTP_FEC_MAX_BLOCK_SIZE (128U) // About 0.8% redundancy
+
+#define TRFTP_DELTA_LITERAL (0xFFFF'FFFFU) // TrftpDeltaOp offset of bytes carried by the delta itself
+
+#define TRFTP_COMPRESSION_BLOCK_SIZE (65536U) // Bytes of the file per compressed block
+
+#define TRFTP_MANIFEST_MAX_PATH (4096U) // Bytes of a path in the manifest of a directory
+
 enum class MessageId : std::uint32_t
 {
     NTF = 0x4500'000F,
@@ -16,6 +45,8 @@ enum class MessageId : std::uint32_t
     CXL = 0x45FD'000C,
     DATA = 0x45FD'000D,
     RTX = 0x45FD'000E,
+    SACK = 0x45FD'0005,
+    FEC = 0x45FD'0006,
     DONE = 0x45FD'000F,
     FIN = 0x45FD'000A
 };
@@ -34,18 +65,13 @@ struct TrftpHeader
     std::uint16_t spid;
     std::uint16_t dpid;
     std::uint32_t tpn;
-    std::uint32_t tpl;
+    std::uint32_t tpl; // Low 32 bits of the total payload length, tpn and psn count packets and need no more
     std::uint32_t xid;
     std::uint32_t crc32;
     std::uint32_t psn;
     std::uint32_t pl;
 };
 
-struct TrftpNtf
-{
-    std::uint32_t new_file_version;
-};
-
 struct TrftpChk
 {
     std::uint32_t cur_file_version;
@@ -56,6 +82,20 @@ struct TrftpInfo
     std::uint32_t new_file_version;
     std::uint32_t file_length;
     std::uint32_t crc32;
+    std::uint32_t payload_size;      // Largest DATA payload the server offers, absent from older servers
+    std::uint32_t features;          // TRFTP_FEATURE_* the server supports, absent from older servers
+    std::uint32_t delta_length;      // DATA bytes of a delta against the client's version, 0 (or absent) if none
+    std::uint32_t delta_base_length; // Length of the version the delta applies to
+    std::uint32_t delta_base_crc32;  // CRC32 of the version the delta applies to
+    std::uint32_t compressed_length; // DATA bytes of the file compressed, 0 (or absent) if not offered
+    std::uint32_t bundle_files;      // Files of the directory DATA carries, 0 (or absent) for a single file
+    std::uint64_t large_file_length; // File length in full, absent from older servers
+};
+
+struct TrftpNtf
+{
+    std::uint32_t new_file_version;
+    TrftpInfo info; // Sent ahead for a fast handshake, absent otherwise and from older servers
 };
 
 struct TrftpRdy
@@ -63,11 +103,68 @@ struct TrftpRdy
     std::uint32_t new_file_version;
     std::uint32_t file_length;
     std::uint32_t inter_packet_gap;
+    std::uint32_t payload_size;      // DATA payload chosen by the client, absent from older clients
+    std::uint32_t receive_window;    // DATA packets accepted past the last acknowledged PSN, 0 (or absent) without SACK
+    std::uint32_t fec_block_size;    // DATA packets per parity packet, 0 (or absent) without FEC
+    std::uint32_t resume_psn;        // Every PSN below it is held by the client already, 0 (or absent) starts over
+    std::uint32_t delta_length;      // INFO's delta length to receive the delta, 0 (or absent) for the whole file
+    std::uint32_t compressed_length; // INFO's compressed length to receive the file compressed, 0 (or absent) if not
+    std::uint32_t bundle_files;      // INFO's file count to receive the directory, 0 (or absent) for a single file
+    std::uint64_t large_file_length; // Same as INFO's, absent from older clients
+    std::uint32_t cur_file_version;  // Same as CHK's, only in reply to an NTF carrying INFO, which takes no CHK
+    std::uint8_t held_psns[TRFTP_SACK_BITMAP_SIZE]; // Bit i (LSB first) set: PSN resume_psn + i is held already. Only
+                                                    // the bytes up to the last one set are sent, none if there is none
 };
 
+// Older peers send NTF, INFO, RDY, RTX and DONE without the fields added after them and always use TRFTP_PAYLOAD_SIZE
+#define TRFTP_LEGACY_NTF_SIZE  (offsetof(TrftpNtf, info))
+#define TRFTP_LEGACY_INFO_SIZE (offsetof(TrftpInfo, payload_size))
+#define TRFTP_LEGACY_RDY_SIZE  (offsetof(TrftpRdy, payload_size))
+#define TRFTP_LEGACY_RTX_SIZE  (offsetof(TrftpRtx, receive_drops))
+#define TRFTP_LEGACY_DONE_SIZE (offsetof(TrftpDone, large_file_length))
+
 struct TrftpData
 {
-    char new_file_data[1408];
+    char new_file_data[TRFTP_MAX_PAYLOAD_SIZE];
+};
+
+// Parity of the DATA packets [psn, psn + fec_block_size), each zero-padded to the payload size
+struct TrftpFec
+{
+    std::uint8_t parity[TRFTP_MAX_PAYLOAD_SIZE];
+};
+
+// DATA of a delta is a sequence of these, each rebuilding the next length bytes of the file. Literal bytes follow
+// their operation, the others are copied from offset of the client's current version.
+struct TrftpDeltaOp
+{
+    std::uint32_t offset; // TRFTP_DELTA_LITERAL, or where to copy from
+    std::uint32_t length;
+};
+
+// DATA of a compressed file is a sequence of these, each followed by compressed_length bytes that decompress to the
+// next raw_length bytes of the file. A block that does not compress is carried as it is (compressed_length ==
+// raw_length).
+struct TrftpCompressedBlock
+{
+    std::uint32_t raw_length; // TRFTP_COMPRESSION_BLOCK_SIZE but for the last block
+    std::uint32_t compressed_length;
+};
+
+// DATA of a directory starts with its manifest: this header, then a TrftpManifestEntry per file, each followed by
+// path_length bytes of its path relative to the directory ('/'-separated, not terminated). The files follow the
+// manifest in its order, each followed by its 4-byte CRC32, which the server calculates while the stream is sent.
+// INFO's file length and CRC32 are those of the whole stream and of the manifest.
+struct TrftpManifest
+{
+    std::uint32_t length;     // Bytes of the manifest, this header included
+    std::uint32_t file_count; // Same as INFO's
+};
+
+struct TrftpManifestEntry
+{
+    std::uint64_t file_length;
+    std::uint32_t path_length;
 };
 
 struct TrftpDone
@@ -75,6 +172,7 @@ struct TrftpDone
     std::uint32_t new_file_version;
     std::uint32_t file_length;
     std::uint32_t crc32;
+    std::uint64_t large_file_length; // Same as INFO's, absent from older clients
 };
 
 struct TrftpCxl
@@ -84,6 +182,16 @@ struct TrftpCxl
 struct TrftpRtx
 {
     std::uint32_t retransmit_psn;
+    std::uint32_t receive_drops; // Datagrams the client's kernel dropped during the transfer, absent from older clients
+};
+
+struct TrftpSack
+{
+    std::uint32_t base_psn;                      // Every PSN below it has been received
+    std::uint32_t receive_drops;                 // Same as in RTX
+    std::uint32_t receive_window;                // Same as in RDY, may change during the transfer
+    std::uint32_t bitmap_bits;                   // PSNs [base_psn, base_psn + bitmap_bits) covered by the bitmap
+    std::uint8_t bitmap[TRFTP_SACK_BITMAP_SIZE]; // Bit i (LSB first) set: PSN base_psn + i is missing
 };
 
 struct TrftpMessage
@@ -91,15 +199,17 @@ struct TrftpMessage
     TrftpHeader header; // Access the common header
 
     union {
-        std::uint8_t payload[1408];
+        std::uint8_t payload[TRFTP_MAX_PAYLOAD_SIZE];
         TrftpNtf ntf;   // Notification message
         TrftpChk chk;   // Check message
         TrftpInfo info; // Info message
         TrftpRdy rdy;   // Ready message
         TrftpData data; // Data message
+        TrftpFec fec;   // Parity message
         TrftpDone done; // Done message
         TrftpCxl cxl;   // Cancel message
         TrftpRtx rtx;   // Retransmit message
+        TrftpSack sack; // Selective acknowledgement message
     };
 };
 
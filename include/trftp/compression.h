@@ -0,0 +1,26 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "trftp/common.h"
+
+namespace trftp
+{
+
+/**
+ * Byte-oriented LZ77 in the LZ4 block layout, built in so compression needs no external library.
+ * Each TRFTP_COMPRESSION_BLOCK_SIZE block of a file is compressed on its own, so the receiver can
+ * decompress the stream block by block as it arrives.
+ */
+
+// Compresses a whole file into a sequence of TrftpCompressedBlock, storing blocks that do not compress as they are
+std::vector<std::uint8_t> CompressStream(const std::uint8_t *data, std::size_t size);
+
+// Decompresses one block, false unless it is well-formed and fills exactly raw_len bytes
+bool DecompressBlock(const std::uint8_t *src, std::size_t len, std::uint8_t *dst, std::size_t raw_len);
+
+} // namespace trftp
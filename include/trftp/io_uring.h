@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace trftp
+{
+
+enum class IoBackend
+{
+    BLOCKING, // Plain (blocking) system calls, always available
+    IO_URING  // Batched submission through io_uring, needs TRFTP_WITH_IO_URING and Linux 5.6+
+};
+
+/**
+ * Minimal io_uring submission/completion ring, driven with raw system calls (no liburing dependency).
+ * Not thread-safe: the owner serializes access.
+ */
+class IoUring
+{
+public:
+    explicit IoUring(unsigned entries = 64);
+    ~IoUring();
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    static bool IsSupported();
+
+    unsigned Capacity() const;
+    bool PrepareSendmsg(int fd, const msghdr *msg, std::uint64_t user_data);
+    bool PrepareRecvmsg(int fd, msghdr *msg, int flags, std::uint64_t user_data);
+    bool PrepareWrite(int fd, const void *buf, std::size_t len, std::uint64_t offset, std::uint64_t user_data);
+    bool PrepareRead(int fd, void *buf, std::size_t len, std::uint64_t offset, std::uint64_t user_data);
+
+    // Submits every prepared entry with one io_uring_enter() and waits for `wait_nr` completions
+    bool Submit(unsigned wait_nr);
+    bool PopCompletion(std::uint64_t &user_data, std::int32_t &res);
+
+private:
+    void *GetSqe();
+    void Release();
+
+    int fd_;
+    unsigned entries_;
+
+    void *sq_ring_;
+    void *cq_ring_;
+    void *sqes_;
+    std::size_t sq_ring_size_;
+    std::size_t cq_ring_size_;
+
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned *sq_mask_;
+    unsigned *sq_array_;
+    unsigned sqe_tail_; // Prepared, not yet published to the kernel
+
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned *cq_mask_;
+    void *cqes_;
+};
+
+} // namespace trftp
\ No newline at end of file
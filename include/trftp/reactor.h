@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace trftp
+{
+
+/**
+ * Single-threaded event loop: epoll over registered descriptors, an eventfd to wake it up
+ * and timerfds for protocol timeouts. Handlers run on the thread that calls Run().
+ * It drives every socket a Server or Client receives on and the client's timeouts. Sending
+ * DATA is not driven by it: each ServerTransaction paces its DATA on a thread of its own.
+ */
+class Reactor
+{
+public:
+    using Handler = std::function<void()>;
+
+    explicit Reactor();
+    ~Reactor();
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    void Add(int fd, Handler handler);
+    void Remove(int fd);
+
+    int AddTimer(Handler handler);
+    void ArmTimer(int timer_fd, std::chrono::microseconds timeout) const; // One-shot, zero disarms
+    void RemoveTimer(int timer_fd);
+
+    void Run();
+    void Stop();
+
+private:
+    int epoll_fd_;
+    int event_fd_;
+    std::atomic_bool is_running_;
+
+    std::mutex mutex_;
+    std::unordered_map<int, std::shared_ptr<Handler>> handlers_;
+};
+
+} // namespace trftp
\ No newline at end of file
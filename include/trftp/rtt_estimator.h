@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <optional>
+
+namespace trftp
+{
+
+/**
+ * Smoothed round-trip time and retransmission timeout of a path (RFC 6298), fed with the kernel
+ * timestamps of a request leaving and its reply arriving on the same socket.
+ */
+class RttEstimator
+{
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    explicit RttEstimator();
+
+    void AddSample(Duration sent, Duration received); // Ignored unless both timestamps are set and in order
+    std::optional<Duration> SmoothedRtt() const;
+    Duration Timeout(Duration min, Duration max) const; // min until the first sample
+    void Reset();
+
+private:
+    mutable std::mutex mutex_;
+    bool has_sample_;
+    Duration srtt_;
+    Duration rttvar_;
+};
+
+} // namespace trftp
\ No newline at end of file
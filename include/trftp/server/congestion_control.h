@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <memory>
+
+namespace trftp
+{
+
+#define CC_GAP_MIN  (std::chrono::nanoseconds(1'000))      // 1 usec, about 11 Gbit/s with the default payload
+#define CC_GAP_MAX  (std::chrono::nanoseconds(10'000'000)) // 10 msec
+#define CC_RTT_INIT (std::chrono::nanoseconds(10'000'000)) // Assumed RTT until the first sample
+
+enum class CongestionAlgorithm
+{
+    FIXED, // Gap requested by the client in RDY, widened only when the client's receive buffer overflows
+    AIMD,  // Loss-based: slow start, then additive increase and multiplicative decrease
+    DELAY, // Delay-based: paces at the measured bottleneck bandwidth and probes for more, like BBR
+};
+
+/**
+ * Paces the DATA of one transaction from the client's feedback.
+ * OnAck(), OnLoss() and OnReceiverDrops() are called under the transaction's lock, InterPacketGap() may be read
+ * from the DATA thread at any time.
+ */
+class CongestionControl
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    virtual ~CongestionControl() = default;
+
+    static std::unique_ptr<CongestionControl> Create(CongestionAlgorithm algorithm, std::chrono::nanoseconds initial_gap);
+
+    // acked: packets newly covered by the cumulative ACK, rtt: latest sample or zero
+    virtual void OnAck(std::uint32_t acked, std::chrono::nanoseconds rtt, Clock::time_point now) = 0;
+    virtual void OnLoss(std::uint32_t lost, Clock::time_point now) = 0;
+    virtual void OnReceiverDrops(std::uint32_t dropped, Clock::time_point now);
+
+    std::chrono::nanoseconds InterPacketGap() const;
+
+protected:
+    explicit CongestionControl(std::chrono::nanoseconds initial_gap);
+
+    double Rate() const; // Packets per second
+    void SetRate(double rate);
+
+private:
+    std::atomic<std::chrono::nanoseconds> gap_;
+};
+
+class FixedRateControl : public CongestionControl
+{
+public:
+    explicit FixedRateControl(std::chrono::nanoseconds gap, std::chrono::nanoseconds max_gap);
+
+    void OnAck(std::uint32_t acked, std::chrono::nanoseconds rtt, Clock::time_point now) override;
+    void OnLoss(std::uint32_t lost, Clock::time_point now) override;
+    void OnReceiverDrops(std::uint32_t dropped, Clock::time_point now) override;
+
+private:
+    std::chrono::nanoseconds max_gap_;
+};
+
+class AimdControl : public CongestionControl
+{
+public:
+    explicit AimdControl(std::chrono::nanoseconds initial_gap);
+
+    void OnAck(std::uint32_t acked, std::chrono::nanoseconds rtt, Clock::time_point now) override;
+    void OnLoss(std::uint32_t lost, Clock::time_point now) override;
+
+private:
+    bool slow_start_;
+    std::chrono::nanoseconds srtt_;
+    Clock::time_point recovery_end_; // Losses before it belong to the decrease already made
+};
+
+class DelayControl : public CongestionControl
+{
+public:
+    explicit DelayControl(std::chrono::nanoseconds initial_gap);
+
+    void OnAck(std::uint32_t acked, std::chrono::nanoseconds rtt, Clock::time_point now) override;
+    void OnLoss(std::uint32_t lost, Clock::time_point now) override;
+    void OnReceiverDrops(std::uint32_t dropped, Clock::time_point now) override;
+
+private:
+    enum class Phase
+    {
+        STARTUP, // Double the rate every round until the bandwidth stops growing
+        DRAIN,   // Empty the queue built up during startup
+        PROBE,   // Cycle around the bottleneck bandwidth
+    };
+
+    double PacingGain() const;
+
+    Phase phase_;
+    std::size_t cycle_index_;
+    Clock::time_point round_start_;
+    std::chrono::nanoseconds min_rtt_;
+    Clock::time_point min_rtt_time_;
+    Clock::time_point last_ack_time_;
+    std::deque<double> bandwidth_samples_; // Delivery rates of the last acknowledgements
+    double bottleneck_bandwidth_;          // Largest recent delivery rate
+    double full_bandwidth_;                // Bandwidth at the last startup round that still grew
+    std::uint32_t full_bandwidth_rounds_;  // Startup rounds since then
+};
+
+} // namespace trftp
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "trftp/common.h"
+#include "trftp/server/file_source.h"
+#include "trftp/util.h"
+
+namespace trftp
+{
+
+#define BUNDLE_CRC32_CHUNK_SIZE (1U << 20) // Bytes of a file checksummed at a time
+
+/**
+ * The regular files of a directory (and its subdirectories) as one DATA stream: their manifest, then each file in path
+ * order followed by its CRC32.
+ * DATA is sent from the shared mappings of the files, only a payload spanning two of them is copied together. The
+ * CRC32 of each file is calculated on a thread of its own while the stream is sent, which has the kernel read each
+ * next file ahead while the current one is checksummed.
+ */
+class FileBundle
+{
+public:
+    explicit FileBundle(const std::filesystem::path &dir_path);
+    ~FileBundle();
+    FileBundle(const FileBundle &) = delete;
+    FileBundle &operator=(const FileBundle &) = delete;
+
+    std::size_t Size() const;
+    std::uint32_t FileCount() const;
+    std::uint32_t ManifestCrc32() const;
+    const std::uint8_t *Payload(std::uint64_t offset, std::size_t len); // Waits for the CRC32 of a file it ends
+
+private:
+    struct Segment
+    {
+        std::uint64_t offset; // In the stream
+        const std::uint8_t *data;
+        std::size_t length;
+        std::size_t crc32_count; // CRC32s calculated before data is in place
+    };
+
+    void Checksum();
+
+    std::vector<std::shared_ptr<FileSource>> sources_; // In manifest order
+    std::vector<std::uint8_t> manifest_;
+    std::uint32_t manifest_crc32_;
+    std::vector<std::uint32_t> crc32s_; // By file, each sent as the file's trailer
+    std::vector<Segment> segments_;     // The manifest, then every (non-empty) file and its CRC32
+    std::size_t size_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::thread thr_;
+    std::size_t crc32_count_;                                                     // Guarded by mtx_
+    bool stopping_;                                                               // Guarded by mtx_
+    std::map<std::pair<std::uint64_t, std::size_t>, std::vector<std::uint8_t>> seams_; // Guarded by mtx_
+};
+
+} // namespace trftp
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "trftp/common.h"
+
+namespace trftp
+{
+
+#define SIGNATURE_BLOCK_MIN (1024U)  // Bytes, smallest block a signature is taken over
+#define SIGNATURE_BLOCK_MAX (65536U) // Bytes, largest block, so that a multi-GB file still matches in places
+
+/**
+ * Rolling and strong checksums of the fixed-size blocks of a file sent earlier (rsync-style).
+ * Clients still holding that version can then be sent a newer one as a delta of literal bytes and
+ * blocks to copy from their own file. Signatures are cached by file version for the lifetime of the process.
+ */
+class FileSignature
+{
+public:
+    using Delta = std::vector<std::uint8_t>; // TrftpDeltaOp sequence, as sent in DATA
+
+    FileSignature(const FileSignature &) = delete;
+    FileSignature &operator=(const FileSignature &) = delete;
+
+    // Takes the signature of a file's content and caches it as the given version
+    static std::shared_ptr<const FileSignature> Store(std::uint32_t file_version, const std::uint8_t *data,
+                                                      std::size_t size);
+    static std::shared_ptr<const FileSignature> Find(std::uint32_t file_version);
+
+    // Encodes a file against this signature. The last delta is kept for the next transaction of the same file.
+    std::shared_ptr<const Delta> Encode(const std::uint8_t *data, std::size_t size, std::uint32_t crc32) const;
+
+    std::size_t Size() const;
+    std::uint32_t Crc32() const;
+
+private:
+    explicit FileSignature(const std::uint8_t *data, std::size_t size);
+
+    std::uint32_t FindBlock(std::uint32_t weak, const std::uint8_t *data) const;
+
+    std::size_t size_;                  // Length of the file in bytes
+    std::uint32_t crc32_;               // CRC32 of the whole file
+    std::uint32_t block_size_;          // About the square root of the file size
+    std::vector<std::uint32_t> strong_; // CRC32 by block
+    std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> blocks_; // Blocks by rolling checksum
+
+    mutable std::mutex delta_mutex_;
+    mutable std::shared_ptr<const Delta> delta_; // Last encoded file, identified by its length and CRC32
+    mutable std::size_t delta_size_;
+    mutable std::uint32_t delta_crc32_;
+};
+
+} // namespace trftp
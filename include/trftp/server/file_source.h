@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "trftp/compression.h"
+#include "trftp/util.h"
+
+namespace trftp
+{
+
+/**
+ * Read-only, memory-mapped view of a file to be sent.
+ * Concurrent transactions for the same (unchanged) file share one mapping, and its compressed form.
+ */
+class FileSource
+{
+public:
+    FileSource(const FileSource &) = delete;
+    FileSource &operator=(const FileSource &) = delete;
+    FileSource(FileSource &&) = delete;
+    FileSource &operator=(FileSource &&) = delete;
+    ~FileSource();
+
+    // Returns the shared mapping of the file, mapping it if no transaction holds it yet
+    static std::shared_ptr<FileSource> Open(const std::filesystem::path &file_path);
+
+    const std::uint8_t *Data() const;
+    std::size_t Size() const;
+    std::uint32_t Crc32() const;                                         // Calculated on first use
+    std::shared_ptr<const std::vector<std::uint8_t>> Compressed() const; // Compressed on first use
+    void WillNeed() const; // Starts reading the file into the page cache ahead of its use
+
+private:
+    explicit FileSource(const std::filesystem::path &file_path);
+
+    std::uint8_t *data_;    // Start of the mapping (nullptr for an empty file)
+    std::size_t size_;      // Length of the file in bytes
+    struct timespec mtime_; // Modification time when mapped, to detect a replaced file
+
+    mutable std::once_flag crc32_once_;
+    mutable std::uint32_t crc32_;
+
+    mutable std::once_flag compressed_once_;
+    mutable std::shared_ptr<const std::vector<std::uint8_t>> compressed_; // TrftpCompressedBlock sequence
+};
+
+} // namespace trftp
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "trftp/common.h"
+#include "trftp/server/server_transaction.h"
+#include "trftp/udp_socket.h"
+
+namespace trftp
+{
+
+using namespace std::chrono_literals;
+
+#define TRAN_MULTICAST_JOIN_WINDOW       (1s)    // Clients answering the announcement this long take part
+#define TRAN_MULTICAST_ANNOUNCE_INTERVAL (250ms) // NTF is repeated to the group while the join window is open
+#define TRAN_MULTICAST_SILENCE           (3s)    // A receiver giving no feedback this long is dropped
+#define TRAN_MULTICAST_DATA_TIMEOUT      (5min)  // Longest a session may spend in DATA, as for a single client
+
+/**
+ * One-to-many transfer of a file to the clients that joined a multicast group.
+ * NTF and DATA go to the group through a ServerTransaction addressed to it, so every byte is sent once. Each receiver
+ * answers the announcement with its own CHK, RDY, SACK and DONE, and is answered with INFO and FIN alone. Their SACKs
+ * are merged: DATA is acknowledged up to the slowest receiver, bounded by the smallest receive window, and every hole
+ * any of them reports is repaired once for the whole group.
+ */
+class MulticastSession
+{
+public:
+    explicit MulticastSession(std::shared_ptr<ServerTransaction> group, UdpSocket &udp_socket);
+    MulticastSession(const MulticastSession &) = delete;
+    MulticastSession &operator=(const MulticastSession &) = delete;
+
+    // Announces the file, sends it and returns the receivers (ip:port) that got all of it
+    std::vector<std::string> Run();
+    bool IsReceiver(const sockaddr_in &addr);
+    void OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr);
+
+private:
+    struct Receiver
+    {
+        sockaddr_in address;
+        FtpStatus status;                                // Last message taken from it, CXL once dropped
+        std::uint32_t acked_psn;                         // Every PSN below it was received
+        std::uint32_t receive_window;                    // From RDY and SACK messages
+        std::uint32_t inter_packet_gap;                  // From RDY message
+        std::uint32_t receive_drops;                     // From SACK message
+        std::chrono::steady_clock::time_point last_seen; // Time of its last message
+    };
+
+    static std::string AddressKey(const sockaddr_in &addr);
+    bool IsActive(const Receiver &receiver) const;
+    void StartData();
+    void DropReceiver(Receiver &receiver, const char *reason);
+    void UpdateGroupProgress();
+
+    std::shared_ptr<ServerTransaction> group_; // Addressed to the group, sends NTF and DATA
+    UdpSocket &udp_socket_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool joining_; // The join window is open, CHK from new clients is taken
+    std::unordered_map<std::string, Receiver> receivers_;
+};
+
+} // namespace trftp
@@ -6,8 +6,11 @@
 #include <iostream>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "trftp/common.h"
+#include "trftp/reactor.h"
+#include "trftp/server/multicast_session.h"
 #include "trftp/server/server_transaction.h"
 #include "trftp/server/server_transaction_factory.h"
 #include "trftp/thread_safe_log.h"
@@ -21,22 +24,66 @@ class Server
 public:
     explicit Server(std::uint16_t port,
                     std::shared_ptr<ServerTransactionFactory> factory = std::make_shared<DefaultServerTransactionFactory>());
+    explicit Server(std::uint16_t port, std::size_t receive_shards,
+                    std::shared_ptr<ServerTransactionFactory> factory = std::make_shared<DefaultServerTransactionFactory>());
     explicit Server(std::shared_ptr<ServerTransactionFactory> factory = std::make_shared<DefaultServerTransactionFactory>());
     ~Server();
 
     FtpStatus StartFileTransfer(const std::string &client_uri, const std::filesystem::path &file_path,
                                 std::uint32_t file_version, const Device device = Device());
+    std::vector<std::string> StartMulticastTransfer(const std::string &group_uri, const std::filesystem::path &file_path,
+                                                    std::uint32_t file_version, const Device device = Device());
     void AbortFileTransfer(const std::string &client_ip);
+    bool SetSegmentOffload(bool enable);
+    bool SetIoBackend(IoBackend backend);
+    bool SetZeroCopy(bool enable);
+    bool SetPayloadSize(std::uint32_t payload_size);
+    bool SetPathMtuProbe(bool enable);
+    bool SetReceiveBuffer(std::size_t bytes);
+    bool SetSendBuffer(std::size_t bytes);
+    bool SetTimestamping(Timestamping mode);
+    void SetCongestionControl(CongestionAlgorithm algorithm);
+    void SetDeltaTransfer(bool enable);
+    void SetCompression(bool enable);
+    void SetFastHandshake(bool enable);
+    void AddDeltaBase(const std::filesystem::path &file_path, std::uint32_t file_version);
+    bool SetMulticastInterface(const std::string &interface_ip);
+    bool SetMulticastLoop(bool enable);
 
 private:
-    void HandleIncomingMessages();
+    // Additional SO_REUSEPORT socket on the server port, with its own receive thread
+    struct ReceiveShard
+    {
+        explicit ReceiveShard(std::uint16_t port)
+            : udp_socket(port, true)
+        {
+        }
 
-    UdpSocket udp_socket_;
-    std::atomic_bool is_running_;
-    std::thread thread_;
+        UdpSocket udp_socket;
+        Reactor reactor;
+        std::thread thread;
+    };
+
+    void HandleIncomingMessages(UdpSocket &udp_socket);
+    std::shared_ptr<ServerTransaction> FindTransaction(const std::string &client_ip);
+    std::shared_ptr<MulticastSession> FindMulticastSession();
+    void RemoveTransaction(const std::string &client_ip);
+
+    UdpSocket udp_socket_; // Shard 0, also used for sending
+    Reactor reactor_;
+    std::vector<std::unique_ptr<ReceiveShard>> shards_;
 
     std::shared_ptr<ServerTransactionFactory> factory_;
+    std::atomic_uint32_t payload_size_; // Largest DATA payload offered to clients
+    std::atomic_bool path_mtu_probe_;
+    std::atomic<CongestionAlgorithm> congestion_algorithm_;
+    std::atomic_bool delta_transfer_; // Versions sent are kept as delta bases and clients holding one get a delta
+    std::atomic_bool compression_;    // Files are offered compressed, unless they do not compress
+    std::atomic_bool fast_handshake_; // NTF carries INFO and DATA starts ahead of RDY, older clients get the full one
+    std::mutex transactions_mutex_;
     std::unordered_map<std::string, std::shared_ptr<ServerTransaction>> active_transactions_;
+    std::shared_ptr<MulticastSession> multicast_session_; // One group transfer at a time, guarded by transactions_mutex_
+    std::thread thread_;
 };
 
 } // namespace trftp
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 // C++ Standard Library
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
@@ -8,11 +10,20 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <optional>
+#include <set>
 #include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 // TRFTP
 #include "trftp/common.h"
+#include "trftp/rtt_estimator.h"
+#include "trftp/server/congestion_control.h"
+#include "trftp/server/file_bundle.h"
+#include "trftp/server/file_signature.h"
+#include "trftp/server/file_source.h"
 #include "trftp/thread_safe_log.h"
 #include "trftp/udp_socket.h"
 #include "trftp/util.h"
@@ -20,11 +31,23 @@
 namespace trftp
 {
 
-#define TRAN_IPG_MIN (100U) // 100 usec
-#define TRAN_IPG_MAX (300U) // 300 usec
+using namespace std::chrono_literals;
+
+#define TRAN_IPG_MIN (100U) // 100 usec, bounds the gap a client may request in RDY
+#define TRAN_IPG_MAX (300U) // 300 usec, and the gap of clients that cannot acknowledge DATA
+
+#define TRAN_BURST_SIZE (16U)     // DATA packets per SendBatch() burst
+#define TRAN_BURST_PARITY (9U)    // FEC packets a burst may add, TRAN_BURST_SIZE / TRFTP_FEC_MIN_BLOCK_SIZE + 1
+#define TRAN_ZEROCOPY_BURSTS (4U) // Bursts whose headers the kernel may still be reading with zero-copy sends
+#define TRAN_SEND_TIMES (8192U)   // DATA send times kept for RTT samples, more than any receive window
+
+#define TRAN_RESPONSE_TIMEOUT_MIN (1s)  // Reply timeout until the path RTT is known, and never less than this
+#define TRAN_RESPONSE_TIMEOUT_MAX (10s) // Reply timeout on the slowest paths
 
 class ServerTransaction
 {
+    friend class MulticastSession; // Drives a transaction to a multicast group with its receivers' feedback
+
 public:
     explicit ServerTransaction(const sockaddr_in &addr, const std::filesystem::path &file_path, std::uint32_t file_version,
                                const std::uint32_t device_id);
@@ -33,47 +56,100 @@ public:
     ServerTransaction(const ServerTransaction &) = delete;
     ServerTransaction &operator=(const ServerTransaction &) = delete;
 
+    void OfferPayloadSize(std::uint32_t payload_size, bool probe);
+    void OfferFastHandshake();
+    void SetCongestionControl(CongestionAlgorithm algorithm);
+    bool PrepareDelta();
+    bool PrepareCompression();
+    bool AbandonPathMtuProbe();
+    bool AbandonFastHandshake();
     void SendMessage(MessageId id, UdpSocket &udp_socket);
-    void OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr);
-    std::optional<FtpStatus> WaitForStatus(std::chrono::seconds timeout);
+    void OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr, Timestamp rx_time = {});
+    std::optional<FtpStatus> WaitForStatus(std::chrono::milliseconds timeout);
+    std::chrono::milliseconds ResponseTimeout() const;
+    std::optional<std::chrono::microseconds> PathRtt() const;
+    std::uint32_t ReceiverDrops() const;
 
 protected:
-    virtual void CompleteHeader(TrftpMessage &msg, const MessageId xid, const std::uint32_t tpl,
+    virtual void CompleteHeader(TrftpMessage &msg, const MessageId xid, const std::uint64_t tpl,
                                 const std::uint32_t psn) const;
+    virtual void CompleteHeader(TrftpHeader &header, const std::uint8_t *payload, const MessageId xid,
+                                const std::uint64_t tpl, const std::uint32_t psn) const;
     virtual bool ValidateMessageIntegrity(const TrftpMessage &msg, std::size_t len) const;
     virtual bool ValidateMessage(const TrftpChk &payload, std::size_t payload_len) const;
     virtual bool ValidateMessage(const TrftpRdy &payload, std::size_t payload_len) const;
     virtual bool ValidateMessage(const TrftpDone &payload, std::size_t payload_len, const TrftpDone &expected) const;
     virtual bool ValidateMessage(const TrftpCxl &payload, std::size_t payload_len) const;
     virtual bool ValidateMessage(const TrftpRtx &payload, std::size_t payload_len, const TrftpRtx &expected) const;
+    virtual bool ValidateMessage(const TrftpSack &payload, std::size_t payload_len) const;
+    virtual std::unique_ptr<CongestionControl> CreateCongestionControl(CongestionAlgorithm algorithm,
+                                                                       std::chrono::nanoseconds initial_gap) const;
 
 private:
+    void SendMessageTo(MessageId id, UdpSocket &udp_socket, const sockaddr_in &addr);
+    void SendFastNotification(UdpSocket &udp_socket);
     void SendFileAsync(UdpSocket &udp_socket);
+    void CalculateBlockParity(std::uint32_t first_psn, std::uint8_t *parity) const;
+    const std::uint8_t *Payload(std::uint32_t psn, std::size_t len) const;
+    void AcknowledgeData(std::uint32_t acked_psn, CongestionControl::Clock::time_point now); // With mtx_ held
+    std::uint32_t QueueRetransmits(const TrftpSack &sack);                                   // With mtx_ held
+    void UpdateReceiverDrops(std::uint32_t receive_drops);
+    void CompleteInfo(TrftpInfo &info) const;
+    TrftpDone ExpectedDone() const;
 
-    void PrintRecvLog(const TrftpMessage &msg) const;
-    void PrintSendLog(const TrftpMessage &msg) const;
+    void PrintRecvLog(const TrftpMessage &msg, const sockaddr_in &addr) const;
+    void PrintSendLog(const TrftpHeader &header, const sockaddr_in &addr) const;
 
     // Informations about the file to be sent
     std::filesystem::path file_path_;
+    std::shared_ptr<FileSource> file_source_;
+    std::shared_ptr<FileBundle> bundle_; // Instead of file_source_ when file_path_ is a directory
     std::uint32_t new_file_version_;
-    std::uint32_t new_file_size_;
+    std::uint64_t new_file_size_;
     std::uint32_t new_file_crc32_;
+    std::shared_ptr<const FileSignature> delta_base_;             // Cached signature of the client's version, if any
+    std::shared_ptr<const FileSignature::Delta> delta_;           // The file encoded against it, offered in INFO
+    std::shared_ptr<const std::vector<std::uint8_t>> compressed_; // The file compressed, offered in INFO
+    const std::uint8_t *data_; // Sent in DATA, the file, its delta or compressed as agreed in RDY (or the directory)
+    std::uint64_t data_length_;
 
     std::atomic<FtpStatus> status_;
+    std::atomic<FtpStatus> sent_status_; // Status set by the last SendMessage()
     std::uint32_t device_id_;
     sockaddr_in client_address_;
+    sockaddr_in notify_address_; // The client's own port NTF goes to, replies come from its transaction's
 
-    std::uint32_t total_packet_number_;                 // (file-length / 1408) [+1]
+    std::uint32_t payload_size_;                        // Offered in INFO, then agreed in RDY
+    bool probe_path_mtu_;                               // INFO is padded to a full DATA datagram
+    bool fast_handshake_;                               // NTF carries INFO and RDY answers it, there is no CHK
+    std::uint32_t speculative_psn_;                     // DATA sent ahead of RDY, [0..speculative_psn_)
+    std::uint32_t features_;                            // TRFTP_FEATURE_* offered in INFO
+    std::uint32_t total_packet_number_;                 // (file-length / payload-size) [+1]
     std::atomic<std::uint32_t> packet_sequence_number_; // [0..(tpn-1)]
     std::atomic<std::uint32_t> retransmit_psn_;         // default:-1, [0..(tpn-1)] but must less than 'psn'
+    std::set<std::uint32_t> retransmit_psns_;           // Missing PSNs reported by SACK, guarded by mtx_
 
     // Data informed from the client
-    std::uint32_t cur_file_version_;             // From CHK message
-    std::chrono::microseconds inter_packet_gap_; // From RDY message
+    std::uint32_t cur_file_version_;            // From CHK (or a fast RDY) message
+    std::atomic<std::uint32_t> receiver_drops_; // From RTX message, dropped by the client's kernel
+    std::atomic<std::uint32_t> receive_window_; // From RDY and SACK messages, 0 leaves DATA unbounded
+    std::atomic<std::uint32_t> acked_psn_;      // From SACK message, every PSN below it was received
+    std::uint32_t fec_block_size_;              // From RDY message, 0 sends no parity
+    std::uint32_t resume_psn_;                  // From RDY message, first PSN of DATA
+    std::vector<bool> held_psns_;               // From RDY message, PSN resume_psn_ + i is held and not sent
+
+    // DATA pacing, created at RDY from the client's inter-packet gap and fed by SACK, RTX and receiver drops
+    CongestionAlgorithm congestion_algorithm_;
+    std::unique_ptr<CongestionControl> congestion_control_;
+    std::vector<CongestionControl::Clock::time_point> send_times_; // By PSN % TRAN_SEND_TIMES, zero if retransmitted
+
+    // Path measurements from kernel timestamps (zero when timestamping is off)
+    std::atomic<Timestamp> request_sent_time_; // TX time of the last NTF or INFO
+    RttEstimator rtt_;                         // Sampled by NTF -> CHK (or RDY) and INFO -> RDY
 
     std::mutex mtx_;
     std::condition_variable cv_;
-    std::thread thr_;
+    std::thread thr_; // Sends and paces DATA, apart from the server's reactor
 };
 
 } // namespace trftp
\ No newline at end of file
@@ -1,29 +1,132 @@
 #pragma once
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
+#include <cstring>
 #include <functional>
+#include <limits>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
 #include <memory>
 #include <mutex>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <unordered_map>
+#include <vector>
 
 #include "trftp/common.h"
+#include "trftp/io_uring.h"
 
 namespace trftp
 {
 
+enum class Timestamping
+{
+    NONE,
+    SOFTWARE, // Taken by the kernel when a packet enters or leaves the stack (CLOCK_REALTIME)
+    HARDWARE, // Taken by the NIC, which must have been configured for it (SIOCSHWTSTAMP)
+};
+
+using Timestamp = std::chrono::nanoseconds; // Kernel or NIC time of a packet, zero when not available
+
 class UdpSocket
 {
 public:
-    explicit UdpSocket(std::uint16_t port = 0);
+    explicit UdpSocket(std::uint16_t port = 0, bool reuse_port = false);
     ~UdpSocket();
 
+    static std::uint32_t PathMtu(const sockaddr_in &addr); // MTU of the route to addr, 0 if unknown
+
+    int Fd() const;
     bool SetReadTimeout(std::chrono::microseconds ms) const;
-    std::size_t Receive(TrftpMessage &msg, sockaddr_in &addr) const;
-    std::size_t Send(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr);
+    bool SetSegmentOffload(bool enable);
+    bool SetReceiveOffload(bool enable);
+    bool SetIoBackend(IoBackend backend);
+    bool SetReusePortSteering(std::uint32_t group_size) const;
+    bool SetPathMtuProbe(bool enable);
+    bool JoinGroup(const in_addr &group, const in_addr &interface) const;
+    bool SetMulticastInterface(const in_addr &interface) const;
+    bool SetMulticastLoop(bool enable) const;
+    bool SetReceiveBuffer(std::size_t bytes) const;
+    bool SetSendBuffer(std::size_t bytes) const;
+    bool SetDropAccounting(bool enable);
+    std::uint32_t ReceiveDrops() const;
+    bool SetTimestamping(Timestamping mode);
+    bool SetZeroCopy(bool enable);
+    std::uint32_t ZeroCopyTicket() const;
+    bool WaitZeroCopy(std::uint32_t ticket, std::chrono::microseconds timeout);
+    std::size_t ReapErrorQueue();
+    std::size_t Receive(TrftpMessage &msg, sockaddr_in &addr, bool wait = true, Timestamp *rx_time = nullptr);
+    std::size_t ReceiveBatch(TrftpMessage *msgs, std::size_t *lens, sockaddr_in *addrs, std::size_t count,
+                             Timestamp *rx_times = nullptr);
+    std::size_t Send(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr, Timestamp *tx_time = nullptr);
+    std::size_t SendBatch(const TrftpMessage *msgs, const std::size_t *lens, std::size_t count, const sockaddr_in &addr);
+    std::size_t SendBatch(const TrftpHeader *headers, const std::uint8_t *const *payloads,
+                          const std::size_t *payload_lens, std::size_t count, const sockaddr_in &addr);
+    std::size_t SendSegmented(const TrftpMessage *msgs, const std::size_t *lens, std::size_t count,
+                              const sockaddr_in &addr);
+    std::size_t SendSegmented(const TrftpHeader *headers, const std::uint8_t *const *payloads,
+                              const std::size_t *payload_lens, std::size_t count, const sockaddr_in &addr);
 
 private:
+    std::size_t SendIovecs(iovec *iovs, std::size_t iovs_per_msg, std::size_t count, const sockaddr_in &addr);
+    std::size_t SendIovecsUring(mmsghdr *hdrs, std::size_t count);
+    std::size_t SendSegmentedIovecs(iovec *iovs, std::size_t iovs_per_msg, std::size_t count, std::size_t total_len,
+                                    const sockaddr_in &addr);
+    bool SendSuperBuffer(iovec *iovs, std::size_t iov_count, std::size_t segment_size, std::size_t total_len,
+                         const sockaddr_in &addr);
+    std::size_t ReceiveIovecsUring(TrftpMessage *msgs, std::size_t *lens, sockaddr_in *addrs, mmsghdr *hdrs,
+                                   std::size_t count, Timestamp *rx_times);
+    std::size_t ReceiveCoalesced(TrftpMessage *msgs, std::size_t *lens, sockaddr_in *addrs, std::size_t count,
+                                 Timestamp *rx_times);
+    std::size_t SendTimestamped(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr,
+                                Timestamp &tx_time);
+    bool IsZeroCopyComplete(std::uint32_t ticket) const;
+    bool SetBuffer(int option, int force_option, std::size_t bytes) const;
+    std::size_t ControlBytes() const;
+    void ReadControlMessages(msghdr &hdr, Timestamp *rx_time);
+    Timestamp ToTimestamp(const scm_timestamping &stamps) const;
+
     int fd_;
-    std::mutex mutex_;
+    std::atomic_bool segment_offload_;       // UDP_SEGMENT (GSO) is enabled and supported
+    std::atomic_bool receive_offload_;       // UDP_GRO is enabled and supported
+    std::atomic_bool uring_backend_;         // IoBackend::IO_URING is selected, checked before taking ring_mutex_
+    std::atomic_bool drop_accounting_;       // SO_RXQ_OVFL is enabled, received messages carry the drop counter
+    std::atomic_uint32_t rx_drops_;          // Datagrams dropped by the kernel because the receive buffer was full
+    std::atomic<Timestamping> timestamping_; // Source of the RX (and TX) timestamps
+    std::atomic_bool tx_timestamps_;         // SO_TIMESTAMPING is on, so sends may ask for a TX timestamp
+
+    // The kernel keeps every datagram atomic, so only the shared submission ring needs a lock
+    std::mutex ring_mutex_;
+    std::unique_ptr<IoUring> ring_; // Set when IoBackend::IO_URING is selected, guarded by ring_mutex_
+
+    // MSG_ZEROCOPY sends are numbered by the kernel in submission order, so they are issued under zerocopy_mutex_.
+    // A batched send's buffers may be reused once ZeroCopyTicket() taken after it has been reached by WaitZeroCopy().
+    // zerocopy_mutex_ also guards everything read from the error queue.
+    std::atomic_bool zerocopy_;
+    std::mutex zerocopy_mutex_;
+    std::atomic_uint32_t zerocopy_issued_;    // Next notification ID the kernel will assign
+    std::atomic_uint32_t zerocopy_completed_; // Every ID below this has been released by the kernel
+
+    // Completions that arrived ahead of zerocopy_completed_, first -> last ID
+    std::unordered_map<std::uint32_t, std::uint32_t> zerocopy_ranges_;
+
+    // Timestamped sends take turns under tx_mutex_, so each one can claim the TX timestamp reaped right after it
+    std::mutex tx_mutex_;
+    std::unordered_map<std::uint32_t, Timestamp> tx_times_; // Reaped TX timestamps waiting for their sender
+
+    // Coalesced datagram received with UDP_GRO, handed out one segment at a time
+    std::vector<std::uint8_t> gro_buffer_;
+    std::size_t gro_len_;
+    std::size_t gro_offset_;
+    std::size_t gro_segment_size_;
+    sockaddr_in gro_addr_;
+    Timestamp gro_rx_time_;
 };
 
 } // namespace trftp
\ No newline at end of file
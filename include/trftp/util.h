@@ -35,5 +35,6 @@ std::string FtpStatusToString(FtpStatus status);
 
 std::uint32_t CalculateCrc32(const std::uint8_t *buf, std::size_t size, std::uint32_t crc32 = 0U);
 std::uint32_t CalculateFileCrc32(const std::string &download_file);
+void CalculateParity(std::uint8_t *parity, const std::uint8_t *buf, std::size_t size);
 
 } // namespace trftp
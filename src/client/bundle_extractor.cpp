@@ -0,0 +1,247 @@
+#include "trftp/client/bundle_extractor.h"
+
+namespace trftp
+{
+
+BundleExtractor::BundleExtractor()
+    : fd_{ -1 }
+    , stream_length_{ 0 }
+    , file_count_{ 0 }
+    , manifest_crc32_{ 0 }
+    , dir_path_{}
+    , succeeded_{ false }
+    , mtx_{}
+    , cv_{}
+    , thr_{}
+    , received_length_{ 0 }
+    , stopping_{ false }
+    , extracted_{}
+{
+}
+
+BundleExtractor::~BundleExtractor()
+{
+    Stop();
+}
+
+bool BundleExtractor::Start(const std::filesystem::path &stream_path, std::uint64_t stream_length,
+                            std::uint32_t file_count, std::uint32_t manifest_crc32,
+                            const std::filesystem::path &dir_path)
+{
+    Stop();
+
+    fd_ = open(stream_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    stream_length_ = stream_length;
+    file_count_ = file_count;
+    manifest_crc32_ = manifest_crc32;
+    dir_path_ = dir_path;
+    succeeded_ = false;
+    received_length_ = 0;
+    stopping_ = false;
+    extracted_.clear();
+    thr_ = std::thread(&BundleExtractor::Run, this);
+    return true;
+}
+
+void BundleExtractor::Advance(std::uint64_t received_length)
+{
+    if (!thr_.joinable())
+    {
+        return;
+    }
+
+    {
+        std::scoped_lock lock(mtx_);
+        if (received_length <= received_length_)
+        {
+            return;
+        }
+        received_length_ = received_length;
+    }
+    cv_.notify_one();
+}
+
+bool BundleExtractor::Finish()
+{
+    if (!thr_.joinable())
+    {
+        return false;
+    }
+
+    Advance(stream_length_);
+    thr_.join();
+
+    const auto succeeded = succeeded_;
+    Stop();
+    return succeeded;
+}
+
+void BundleExtractor::Stop()
+{
+    if (thr_.joinable())
+    {
+        {
+            std::scoped_lock lock(mtx_);
+            stopping_ = true;
+        }
+        cv_.notify_one();
+        thr_.join();
+    }
+
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+std::vector<std::filesystem::path> BundleExtractor::TakeExtracted()
+{
+    std::scoped_lock lock(mtx_);
+    return std::exchange(extracted_, {});
+}
+
+void BundleExtractor::Run()
+{
+    std::vector<Entry> entries;
+    std::uint64_t offset = 0;
+    if (!ReadManifest(entries, offset))
+    {
+        return;
+    }
+
+    for (const auto &entry : entries)
+    {
+        if (!WaitReceived(offset + entry.file_length + sizeof(std::uint32_t)) || !ExtractFile(entry, offset))
+        {
+            return;
+        }
+
+        offset += entry.file_length + sizeof(std::uint32_t);
+        std::scoped_lock lock(mtx_);
+        extracted_.push_back(dir_path_ / entry.path);
+    }
+
+    succeeded_ = true;
+}
+
+bool BundleExtractor::WaitReceived(std::uint64_t length)
+{
+    std::unique_lock lock(mtx_);
+    cv_.wait(lock, [&]() { return stopping_ || (received_length_ >= length); });
+    return !stopping_;
+}
+
+bool BundleExtractor::ReadManifest(std::vector<Entry> &entries, std::uint64_t &length)
+{
+    TrftpManifest header{};
+    if ((stream_length_ < sizeof(header)) || !WaitReceived(sizeof(header)) || !ReadStream(0, &header, sizeof(header)) ||
+        (header.length < sizeof(header)) || (header.length > stream_length_) || (header.file_count != file_count_))
+    {
+        return false;
+    }
+
+    std::vector<std::uint8_t> manifest(header.length);
+    if (!WaitReceived(header.length) || !ReadStream(0, manifest.data(), manifest.size()) ||
+        (CalculateCrc32(manifest.data(), manifest.size()) != manifest_crc32_))
+    {
+        return false;
+    }
+
+    // Every path has to stay within the directory, and the files and their CRC32s have to fill the rest of the stream
+    // exactly
+    std::uint64_t files_length = 0;
+    for (std::size_t pos = sizeof(header); entries.size() < header.file_count;)
+    {
+        TrftpManifestEntry entry{};
+        if (pos + sizeof(entry) > manifest.size())
+        {
+            return false;
+        }
+        std::memcpy(&entry, manifest.data() + pos, sizeof(entry));
+        pos += sizeof(entry);
+
+        if ((entry.path_length == 0) || (entry.path_length > TRFTP_MANIFEST_MAX_PATH) ||
+            (pos + entry.path_length > manifest.size()) || (entry.file_length > stream_length_))
+        {
+            return false;
+        }
+        const auto *name = reinterpret_cast<const char *>(manifest.data() + pos);
+        std::filesystem::path path(std::string(name, entry.path_length));
+        pos += entry.path_length;
+
+        if (path.is_absolute() || path.filename().empty())
+        {
+            return false;
+        }
+        for (const auto &part : path)
+        {
+            if ((part == "..") || (part == "."))
+            {
+                return false;
+            }
+        }
+
+        entries.push_back({ path, entry.file_length });
+        files_length += entry.file_length + sizeof(std::uint32_t);
+    }
+
+    length = header.length;
+    return header.length + files_length == stream_length_;
+}
+
+bool BundleExtractor::ExtractFile(const Entry &entry, std::uint64_t offset)
+{
+    const auto file_path = dir_path_ / entry.path;
+    std::error_code ec;
+    std::filesystem::create_directories(file_path.parent_path(), ec);
+
+    FileSink sink;
+    if (!sink.Open(file_path, entry.file_length))
+    {
+        return false;
+    }
+
+    std::vector<std::uint8_t> chunk(BUNDLE_EXTRACT_CHUNK_SIZE);
+    std::uint32_t crc32 = 0U;
+    for (std::uint64_t copied = 0; copied < entry.file_length;)
+    {
+        const auto len = std::min<std::uint64_t>(chunk.size(), entry.file_length - copied);
+        if (!ReadStream(offset + copied, chunk.data(), len) || !sink.Write(copied, chunk.data(), len))
+        {
+            return false;
+        }
+
+        crc32 = CalculateCrc32(chunk.data(), len, crc32);
+        copied += len;
+    }
+
+    std::uint32_t expected_crc32 = 0U;
+    return ReadStream(offset + entry.file_length, &expected_crc32, sizeof(expected_crc32)) &&
+           (crc32 == expected_crc32) && sink.Flush() && sink.Commit();
+}
+
+bool BundleExtractor::ReadStream(std::uint64_t offset, void *buf, std::size_t len) const
+{
+    for (auto *dst = static_cast<std::uint8_t *>(buf); len > 0;)
+    {
+        auto n = pread(fd_, dst, len, offset);
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        dst += n;
+        offset += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+} // namespace trftp
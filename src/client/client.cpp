@@ -6,16 +6,17 @@ namespace trftp
 
 Client::Client(std::uint16_t port, std::uint32_t cur_version)
     : udp_socket_(port)
-    , is_running_(true)
-    , thread_(&Client::HandleIncomingMessages, this)
+    , reactor_()
     , file_handler_(nullptr)
-    , transaction_(this, cur_version)
+    , transaction_(this, reactor_, cur_version)
 {
+    reactor_.Add(udp_socket_.Fd(), [this]() { HandleIncomingMessages(); });
+    thread_ = std::thread(&Reactor::Run, &reactor_);
 }
 
 Client::~Client()
 {
-    is_running_ = false;
+    reactor_.Stop();
 
     if (thread_.joinable())
     {
@@ -33,6 +34,73 @@ void Client::DetachFileHandler()
     file_handler_.reset();
 }
 
+void Client::SetDestinationPath(const std::filesystem::path &file_path)
+{
+    transaction_.SetDestinationPath(file_path);
+}
+
+bool Client::SetReceiveOffload(bool enable)
+{
+    return transaction_.SetReceiveOffload(enable);
+}
+
+bool Client::SetIoBackend(IoBackend backend)
+{
+    return transaction_.SetIoBackend(backend);
+}
+
+bool Client::SetPayloadSize(std::uint32_t payload_size)
+{
+    return transaction_.SetPayloadSize(payload_size);
+}
+
+bool Client::SetReceiveBuffer(std::size_t bytes)
+{
+    return transaction_.SetReceiveBuffer(bytes);
+}
+
+bool Client::SetTimestamping(Timestamping mode)
+{
+    return transaction_.SetTimestamping(mode);
+}
+
+bool Client::SetForwardErrorCorrection(std::uint32_t block_size)
+{
+    return transaction_.SetForwardErrorCorrection(block_size);
+}
+
+void Client::SetResumable(bool enable)
+{
+    transaction_.SetResumable(enable);
+}
+
+void Client::SetCompression(bool enable)
+{
+    transaction_.SetCompression(enable);
+}
+
+bool Client::JoinGroup(const std::string &group_uri, const std::string &interface_ip)
+{
+    auto pos = group_uri.find(':');
+    if (pos == std::string::npos)
+    {
+        throw std::runtime_error("Invalid group address (" + group_uri + ")");
+    }
+
+    sockaddr_in group_addr;
+    group_addr.sin_family = AF_INET;
+    group_addr.sin_port = htobe16(std::stoi(group_uri.substr(pos + 1)));
+    group_addr.sin_addr.s_addr = inet_addr(group_uri.substr(0, pos).c_str());
+    if (!IN_MULTICAST(be32toh(group_addr.sin_addr.s_addr)))
+    {
+        throw std::runtime_error("Invalid multicast group IP (" + group_uri.substr(0, pos) + ")");
+    }
+
+    in_addr interface;
+    interface.s_addr = inet_addr(interface_ip.c_str());
+    return transaction_.JoinGroup(group_addr, interface);
+}
+
 void Client::OnFileReceived(const std::string &file_path, const std::uint32_t version) const
 {
     if (file_handler_)
@@ -43,25 +111,25 @@ void Client::OnFileReceived(const std::string &file_path, const std::uint32_t ve
 
 void Client::HandleIncomingMessages()
 {
-    while (is_running_)
-    {
-        TrftpMessage msg;
-        sockaddr_in server_addr;
+    TrftpMessage msg;
+    sockaddr_in server_addr;
 
-        auto len = udp_socket_.Receive(msg, server_addr);
-        if (len == 0)
-        {
-            continue;
-        }
+    auto len = udp_socket_.Receive(msg, server_addr);
+    if (len == 0)
+    {
+        return;
+    }
 
-        if (transaction_.IsAlive())
+    if (transaction_.IsAlive())
+    {
+        if (!transaction_.ReceiveAhead(msg, len, server_addr))
         {
             terr << ClientLog() << "Transaction is already in progress. Discarding..." << std::endl;
         }
-        else
-        {
-            transaction_.Begin(msg, len, server_addr);
-        }
+    }
+    else
+    {
+        transaction_.Begin(msg, len, server_addr);
     }
 }
 
@@ -5,291 +5,1188 @@
 namespace trftp
 {
 
-ClientTransaction::ClientTransaction(Client *client, std::uint32_t file_version)
+ClientTransaction::ClientTransaction(Client *client, Reactor &reactor, std::uint32_t file_version)
     : client_{ client }
     , cur_file_version_{ file_version }
+    , cur_file_crc32_{ 0 }
+    , delta_rejected_{ false }
     , inter_packet_gap_{ std::chrono::microseconds(100) }
     , is_active_{ false }
     , status_{ FtpStatus::FIN }
     , server_address_{}
     , udp_socket_{}
+    , group_socket_{ nullptr }
+    , multicast_{ false }
+    , fast_handshake_{ false }
+    , speculative_data_{ false }
+    , reactor_{ reactor }
+    , timeout_timer_{ -1 }
+    , sack_timer_{ -1 }
+    , max_payload_size_{ TRFTP_MAX_PAYLOAD_SIZE }
+    , payload_size_{ TRFTP_PAYLOAD_SIZE }
+    , legacy_server_{ false }
+    , server_features_{ 0 }
+    , receive_buffer_size_{ 0 }
+    , receive_buffer_packets_{ 0 }
+    , rate_start_{}
+    , rate_packets_{ 0 }
+    , receive_drops_base_{ 0 }
+    , request_sent_time_{ 0 }
+    , rtt_{}
     , total_packet_number_{ 0 }
     , packet_sequence_number_{ 0 }
-    , new_file_stream_{}
+    , selective_ack_{ false }
+    , receive_window_{ 0 }
+    , received_psns_{}
+    , highest_psn_{ 0 }
+    , sack_reported_psn_{ 0 }
+    , sack_acked_psn_{ 0 }
+    , sack_from_psn_{ 0 }
+    , sack_end_psn_{ 0 }
+    , max_fec_block_size_{ 0 }
+    , fec_block_size_{ 0 }
+    , fec_blocks_{}
+    , resumable_{ false }
+    , resume_psn_{ 0 }
+    , delta_length_{ 0 }
+    , compression_{ true }
+    , compressed_length_{ 0 }
+    , data_length_{ 0 }
+    , stream_sink_{}
+    , decompressor_{}
+    , bundle_files_{ 0 }
+    , bundle_extractor_{}
+    , new_file_sink_{}
     , new_file_path_{ std::filesystem::temp_directory_path() / "trftp_temp_file" }
     , new_file_version_{ 0 }
     , new_file_size_{ 0 }
     , new_file_crc32_{ 0 }
 {
-    udp_socket_.SetReadTimeout(3s);
+    udp_socket_.SetDropAccounting(true);
+
+    timeout_timer_ = reactor_.AddTimer([this]() { OnTimeout(); });
+    sack_timer_ = reactor_.AddTimer([this]() { OnSackTimeout(); });
+    reactor_.Add(udp_socket_.Fd(), [this]() { HandleIncomingMessages(); });
+}
+
+ClientTransaction::~ClientTransaction()
+{
+    if (is_active_ && (status_ == FtpStatus::DATA))
+    {
+        SuspendTransfer();
+    }
+
+    reactor_.Remove(udp_socket_.Fd());
+    if (group_socket_)
+    {
+        reactor_.Remove(group_socket_->Fd());
+    }
+    reactor_.RemoveTimer(timeout_timer_);
+    reactor_.RemoveTimer(sack_timer_);
+    Reset();
+}
+
+bool ClientTransaction::IsAlive() const
+{
+    return is_active_;
+}
+
+void ClientTransaction::SetDestinationPath(const std::filesystem::path &file_path)
+{
+    new_file_path_ = file_path;
+}
+
+bool ClientTransaction::SetReceiveOffload(bool enable)
+{
+    return udp_socket_.SetReceiveOffload(enable);
+}
+
+bool ClientTransaction::SetIoBackend(IoBackend backend)
+{
+    auto socket_ok = udp_socket_.SetIoBackend(backend);
+    auto sink_ok = new_file_sink_.SetIoBackend(backend);
+    auto stream_ok = stream_sink_.SetIoBackend(backend);
+    return socket_ok && sink_ok && stream_ok;
+}
+
+bool ClientTransaction::SetPayloadSize(std::uint32_t payload_size)
+{
+    if ((payload_size < TRFTP_MIN_PAYLOAD_SIZE) || (payload_size > TRFTP_MAX_PAYLOAD_SIZE))
+    {
+        return false;
+    }
+
+    max_payload_size_ = payload_size;
+    return true;
+}
+
+bool ClientTransaction::SetReceiveBuffer(std::size_t bytes)
+{
+    receive_buffer_size_ = bytes;
+    return (bytes == 0) || udp_socket_.SetReceiveBuffer(bytes);
+}
+
+bool ClientTransaction::SetTimestamping(Timestamping mode)
+{
+    return udp_socket_.SetTimestamping(mode);
+}
+
+bool ClientTransaction::SetForwardErrorCorrection(std::uint32_t block_size)
+{
+    if ((block_size != 0) && ((block_size < TRFTP_FEC_MIN_BLOCK_SIZE) || (block_size > TRFTP_FEC_MAX_BLOCK_SIZE)))
+    {
+        return false;
+    }
+
+    max_fec_block_size_ = block_size;
+    return true;
+}
+
+void ClientTransaction::SetResumable(bool enable)
+{
+    resumable_ = enable;
+}
+
+void ClientTransaction::SetCompression(bool enable)
+{
+    compression_ = enable;
+}
+
+bool ClientTransaction::JoinGroup(const sockaddr_in &group, const in_addr &interface)
+{
+    if (group_socket_)
+    {
+        return false;
+    }
+
+    // Every client of the host joining the group binds its port, and each receives its own copy of the datagrams
+    auto group_socket = std::make_unique<UdpSocket>(be16toh(group.sin_port), true);
+    if (!group_socket->JoinGroup(group.sin_addr, interface))
+    {
+        return false;
+    }
+    group_socket->SetDropAccounting(true);
+
+    group_socket_ = std::move(group_socket);
+    reactor_.Add(group_socket_->Fd(), [this]() { HandleGroupMessages(); });
+    return true;
 }
 
-ClientTransaction::~ClientTransaction()
-{
-    Reset();
-}
+void ClientTransaction::Begin(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr, bool multicast)
+{
+    const auto &id = MessageId(msg.header.xid);
+    id == MessageId::NTF ? is_active_ = true : is_active_ = false;
+
+    if (is_active_)
+    {
+        Reset();
+        multicast_ = multicast;
+        OnReceive(msg, len, addr);
+    }
+}
+
+bool ClientTransaction::ReceiveAhead(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr)
+{
+    // The server sends the first DATA of a fast handshake to the port NTF went to, as it learns the transaction's own
+    // port from RDY only
+    if (!is_active_ || !fast_handshake_ || (MessageId(msg.header.xid) != MessageId::DATA) ||
+        (addr.sin_addr.s_addr != server_address_.sin_addr.s_addr) || (addr.sin_port != server_address_.sin_port))
+    {
+        return false;
+    }
+
+    // Unless RDY asked for what it carries, the server sends it again
+    if (speculative_data_ && ((status_ == FtpStatus::RDY) || (status_ == FtpStatus::DATA)))
+    {
+        OnReceive(msg, len, addr);
+        CompleteBatch(1);
+    }
+    return true;
+}
+
+void ClientTransaction::Reset()
+{
+    server_address_ = {};
+    multicast_ = false;
+    fast_handshake_ = false;
+    speculative_data_ = false;
+    payload_size_ = TRFTP_PAYLOAD_SIZE;
+    legacy_server_ = false;
+    server_features_ = 0;
+    request_sent_time_ = Timestamp::zero();
+    rtt_.Reset();
+    total_packet_number_ = 0;
+    packet_sequence_number_ = 0;
+    selective_ack_ = false;
+    receive_window_ = 0;
+    receive_buffer_packets_ = 0;
+    received_psns_.clear();
+    highest_psn_ = 0;
+    sack_reported_psn_ = 0;
+    sack_acked_psn_ = 0;
+    sack_from_psn_ = 0;
+    sack_end_psn_ = 0;
+    fec_block_size_ = 0;
+    fec_blocks_.clear();
+    resume_psn_ = 0;
+    delta_length_ = 0;
+    compressed_length_ = 0;
+    data_length_ = 0;
+    decompressor_.Stop();
+    bundle_files_ = 0;
+    bundle_extractor_.Stop();
+    stream_sink_.Discard();
+    new_file_sink_.Discard();
+    new_file_version_ = 0;
+    new_file_size_ = 0;
+    new_file_crc32_ = 0;
+}
+
+void ClientTransaction::HandleIncomingMessages()
+{
+    std::array<TrftpMessage, RECV_BATCH_SIZE> msgs;
+    std::array<std::size_t, RECV_BATCH_SIZE> lens;
+    std::array<sockaddr_in, RECV_BATCH_SIZE> server_addrs;
+    std::array<Timestamp, RECV_BATCH_SIZE> rx_times;
+
+    auto count = udp_socket_.ReceiveBatch(msgs.data(), lens.data(), server_addrs.data(), msgs.size(), rx_times.data());
+
+    // Messages arriving outside of a transaction are stale
+    if (!is_active_)
+    {
+        return;
+    }
+
+    // Validate and write the whole batch before waiting again
+    for (std::size_t i = 0; (i < count) && is_active_; i++)
+    {
+        OnReceive(msgs[i], lens[i], server_addrs[i], rx_times[i]);
+    }
+
+    CompleteBatch(count);
+}
+
+void ClientTransaction::HandleGroupMessages()
+{
+    std::array<TrftpMessage, RECV_BATCH_SIZE> msgs;
+    std::array<std::size_t, RECV_BATCH_SIZE> lens;
+    std::array<sockaddr_in, RECV_BATCH_SIZE> server_addrs;
+    std::array<Timestamp, RECV_BATCH_SIZE> rx_times;
+
+    auto count =
+        group_socket_->ReceiveBatch(msgs.data(), lens.data(), server_addrs.data(), msgs.size(), rx_times.data());
+
+    // Outside of a transaction the group only announces files. During one, only the DATA of the server that announced
+    // it to the group is taken: the announcement is repeated, and other servers may send to the same group.
+    for (std::size_t i = 0; i < count; i++)
+    {
+        const auto &id = MessageId(msgs[i].header.xid);
+        if (!is_active_)
+        {
+            if (id == MessageId::NTF)
+            {
+                Begin(msgs[i], lens[i], server_addrs[i], true);
+            }
+        }
+        else if (multicast_ && (id != MessageId::NTF) &&
+                 (server_addrs[i].sin_addr.s_addr == server_address_.sin_addr.s_addr) &&
+                 (server_addrs[i].sin_port == server_address_.sin_port))
+        {
+            OnReceive(msgs[i], lens[i], server_addrs[i], rx_times[i]);
+        }
+    }
+
+    CompleteBatch(count);
+}
+
+void ClientTransaction::CompleteBatch(std::size_t count)
+{
+    // Queued writes point into the batch, so they must complete before it is reused
+    if (is_active_ && !DataSink().Flush())
+    {
+        terr << ClientLog() << "Failed to write to the file. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+    }
+
+    // What is in order of a compressed stream can be decompressed now, and the files of a directory it completes
+    // put in place
+    const auto received_length =
+        std::min<std::uint64_t>(std::uint64_t(packet_sequence_number_) * payload_size_, data_length_);
+    if (is_active_ && (compressed_length_ > 0))
+    {
+        decompressor_.Advance(received_length);
+    }
+    if (is_active_ && (bundle_files_ > 0))
+    {
+        bundle_extractor_.Advance(received_length);
+    }
+    ReportExtractedFiles();
+
+    if (is_active_ && selective_ack_ && (status_ == FtpStatus::DATA))
+    {
+        ReportProgress(false);
+    }
+
+    // Once per RECV_BUFFER_LATENCY, check that the buffer still absorbs a stall at the rate the server's pacing has
+    // reached, and leave room for it to double
+    if (is_active_ && (receive_buffer_packets_ > 0) && (status_ == FtpStatus::DATA))
+    {
+        rate_packets_ += count;
+        const auto now = std::chrono::steady_clock::now();
+        if (now - rate_start_ >= RECV_BUFFER_LATENCY)
+        {
+            const auto packets = rate_packets_ * std::chrono::nanoseconds(RECV_BUFFER_LATENCY).count() /
+                                 std::chrono::nanoseconds(now - rate_start_).count();
+            if (RECV_BATCH_SIZE + packets > receive_buffer_packets_)
+            {
+                GrowReceiveBuffer(RECV_BATCH_SIZE + 2 * packets);
+            }
+            rate_start_ = now;
+            rate_packets_ = 0;
+        }
+    }
+
+    if (is_active_ && count > 0)
+    {
+        reactor_.ArmTimer(timeout_timer_, ReceiveTimeout());
+        if (selective_ack_)
+        {
+            reactor_.ArmTimer(sack_timer_, SackTimeout());
+        }
+    }
+}
+
+void ClientTransaction::GrowReceiveBuffer(std::uint64_t packets)
+{
+    // Never past RECV_BUFFER_MAX, and with SACK no more than a full window is ever in flight
+    const auto packet_size = sizeof(TrftpHeader) + payload_size_;
+    packets = std::min<std::uint64_t>(packets, RECV_BUFFER_MAX / packet_size);
+    if (selective_ack_)
+    {
+        packets = std::min<std::uint64_t>(packets, RECV_BATCH_SIZE + 8 * TRFTP_SACK_BITMAP_SIZE);
+    }
+    if (packets <= receive_buffer_packets_)
+    {
+        return;
+    }
+
+    // A larger window is announced with the next SACK
+    receive_buffer_packets_ = packets;
+    receive_window_ = selective_ack_
+                          ? std::clamp(static_cast<std::uint32_t>(packets), RECV_BATCH_SIZE, 8 * TRFTP_SACK_BITMAP_SIZE)
+                          : 0;
+    if (!DataSocket().SetReceiveBuffer(packets * packet_size))
+    {
+        // The kernel will not go further, so stop trying
+        receive_buffer_packets_ = std::numeric_limits<std::uint64_t>::max();
+        terr << ClientLog() << "Receive buffer is capped below " << packets * packet_size
+             << " bytes (net.core.rmem_max). Bursts may be dropped..." << std::endl;
+    }
+}
+
+void ClientTransaction::OnTimeout()
+{
+    if (is_active_)
+    {
+        terr << ClientLog() << "Timeout occurred. Cancelling..." << std::endl;
+        SuspendTransfer();
+        SendMessage(MessageId::CXL);
+    }
+}
+
+void ClientTransaction::OnSackTimeout()
+{
+    if (!is_active_ || !selective_ack_ || ((status_ != FtpStatus::RDY) && (status_ != FtpStatus::DATA)))
+    {
+        return;
+    }
+
+    // Nothing arrived for a while: report every packet still missing, including a lost tail
+    ReportProgress(true);
+    reactor_.ArmTimer(sack_timer_, SackTimeout());
+}
+
+void ClientTransaction::ReportProgress(bool silent)
+{
+    const auto base_psn = packet_sequence_number_.load();
+
+    // Holes are reported once, and only when the packets around them can no longer be reordered ones.
+    // Once the server has gone silent, every hole is reported again.
+    sack_from_psn_ = silent ? base_psn : std::max(sack_reported_psn_, base_psn);
+    sack_end_psn_ = silent ? total_packet_number_ : (highest_psn_ - std::min(highest_psn_, RECV_REORDER_DISTANCE));
+
+    // Holes in the newest block may still be rebuilt by its parity, which follows the block's last packet
+    if (!silent && (fec_block_size_ > 0) && (highest_psn_ > 0))
+    {
+        const auto block_psn = (highest_psn_ - 1) - (highest_psn_ - 1) % fec_block_size_;
+        if (auto it = fec_blocks_.find(block_psn); (it == fec_blocks_.end()) || !it->second.has_parity)
+        {
+            sack_end_psn_ = std::min(sack_end_psn_, block_psn);
+        }
+    }
+
+    bool missing = false;
+    for (auto psn = sack_from_psn_; !missing && (psn < sack_end_psn_); psn++)
+    {
+        missing = !received_psns_[psn];
+    }
+
+    // Acknowledge often enough that the server does not stall on a full window
+    if (silent || missing || (base_psn - sack_acked_psn_ >= receive_window_ / 4))
+    {
+        SendMessage(MessageId::SACK);
+    }
+}
+
+void ClientTransaction::OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr,
+                                  Timestamp rx_time)
+{
+    server_address_ = addr;
+    PrintRecvLog(msg);
+
+    if (!ValidateMessageIntegrity(msg, len))
+    {
+        terr << ClientLog() << "Message integrity check failed. Discarding..." << std::endl;
+        return;
+    }
+
+    const auto &id = MessageId(msg.header.xid);
+    const auto &payload_len = len - sizeof(TrftpHeader);
+
+    switch (id)
+    {
+    case MessageId::NTF:
+        // NTF of a fast handshake carries INFO (which may be padded the same way) and is answered with RDY right away
+        if ((payload_len != TRFTP_LEGACY_NTF_SIZE) && (payload_len < sizeof(TrftpNtf)))
+        {
+            terr << ClientLog() << "Invalid message length for <CHK>. Discarding..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+
+        status_ = id;
+        new_file_version_ = msg.ntf.new_file_version;
+        fast_handshake_ = (payload_len >= sizeof(TrftpNtf));
+
+        reactor_.ArmTimer(timeout_timer_, ReceiveTimeout());
+        if (fast_handshake_)
+        {
+            ReceiveInfo(msg.ntf.info, payload_len - TRFTP_LEGACY_NTF_SIZE, addr, rx_time);
+            break;
+        }
+        SendMessage(MessageId::CHK);
+        break;
+
+    case MessageId::INFO:
+        if (status_ != FtpStatus::CHK)
+        {
+            terr << ClientLog() << "Transaction state is not <CHK>. Discarding..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+
+        ReceiveInfo(msg.info, payload_len, addr, rx_time);
+        break;
+
+    case MessageId::DATA:
+        if (status_ == FtpStatus::DONE) // Late copy of a retransmitted packet
+        {
+            break;
+        }
+        if ((status_ != FtpStatus::RDY) && (status_ != FtpStatus::DATA))
+        {
+            terr << ClientLog() << "Transaction state is not <RDY> or <DATA>. Discarding..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+        if ((msg.header.tpn != total_packet_number_) ||
+            (payload_len != ((msg.header.psn == total_packet_number_ - 1)
+                                 ? (data_length_ - std::uint64_t(msg.header.psn) * payload_size_)
+                                 : payload_size_)))
+        {
+            terr << ClientLog() << "Invalid message length for <DATA>. Discarding..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+
+        if (status_ == FtpStatus::RDY) // 첫번째 DATA 패킷
+        {
+            rtt_.AddSample(request_sent_time_, rx_time);
+        }
+
+        if (selective_ack_)
+        {
+            if (msg.header.psn >= packet_sequence_number_ + receive_window_)
+            {
+                terr << ClientLog() << "PSN (" << msg.header.psn << ") is beyond the receive window. Discarding..."
+                     << std::endl;
+                break;
+            }
+            if (received_psns_[msg.header.psn]) // Retransmitted twice, reordered and requested again, or resumed
+            {
+                // Packets held from an interrupted transfer still show how far the server has got
+                highest_psn_ = std::max(highest_psn_, msg.header.psn + 1);
+                break;
+            }
+        }
+        else if (msg.header.psn != packet_sequence_number_)
+        {
+            terr << ClientLog() << "PSN mismatch. Retransmitting..." << std::endl;
+            SendMessage(MessageId::RTX);
+            return;
+        }
+
+        if (!DataSink().Write(std::uint64_t(msg.header.psn) * payload_size_, msg.data.new_file_data,
+                                  payload_len))
+        {
+            terr << ClientLog() << "Failed to write to the file. Cancelling..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+
+        status_ = id;
+        if (selective_ack_)
+        {
+            MarkReceived(msg.header.psn);
+        }
+        else
+        {
+            packet_sequence_number_++;
+        }
+
+        if ((fec_block_size_ > 0) &&
+            !UpdateFecBlock(msg.header.psn, reinterpret_cast<const std::uint8_t *>(msg.data.new_file_data), payload_len,
+                            false))
+        {
+            terr << ClientLog() << "Failed to write to the file. Cancelling..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+
+        if (packet_sequence_number_ == total_packet_number_) // 마지막 패킷까지 수신 완료
+        {
+            FinishTransfer();
+        }
+
+        break;
+
+    case MessageId::FEC:
+        if ((fec_block_size_ == 0) || ((status_ != FtpStatus::RDY) && (status_ != FtpStatus::DATA)))
+        {
+            break;
+        }
+        if ((msg.header.tpn != total_packet_number_) || (msg.header.psn % fec_block_size_ != 0) ||
+            (payload_len != ((msg.header.psn == total_packet_number_ - 1)
+                                 ? (data_length_ - std::uint64_t(msg.header.psn) * payload_size_)
+                                 : payload_size_)))
+        {
+            terr << ClientLog() << "Invalid message length for <FEC>. Discarding..." << std::endl;
+            break;
+        }
+        if (msg.header.psn >= packet_sequence_number_ + receive_window_)
+        {
+            break;
+        }
+
+        if (!UpdateFecBlock(msg.header.psn, msg.fec.parity, payload_len, true))
+        {
+            terr << ClientLog() << "Failed to write to the file. Cancelling..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+
+        if (packet_sequence_number_ == total_packet_number_)
+        {
+            FinishTransfer();
+        }
+
+        break;
+
+    case MessageId::FIN:
+        if (status_ != FtpStatus::DONE)
+        {
+            terr << ClientLog() << "Transaction state is not <DONE>. Discarding..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+        if (payload_len != 0)
+        {
+            terr << ClientLog() << "Invalid message length for <FIN>. Discarding..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+
+        if ((bundle_files_ == 0) && !new_file_sink_.Commit())
+        {
+            terr << ClientLog() << "Failed to move the file to " << new_file_path_ << ". Cancelling..." << std::endl;
+            SendMessage(MessageId::CXL);
+            break;
+        }
+
+        // The file is now the base any later delta applies to
+        status_ = id;
+        is_active_ = false;
+        cur_file_version_ = new_file_version_;
+        cur_file_crc32_ = new_file_crc32_;
+        delta_rejected_ = false;
+        ReportExtractedFiles();
+        if (client_ && (bundle_files_ == 0))
+        {
+            client_->OnFileReceived(new_file_path_, new_file_version_);
+        }
+        break;
+
+    case MessageId::CXL:
+        SuspendTransfer();
+        status_ = id;
+        SendMessage(MessageId::CXL);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void ClientTransaction::ReceiveInfo(const TrftpInfo &info, std::size_t payload_len, const sockaddr_in &addr,
+                                    Timestamp rx_time)
+{
+    // The server may pad INFO up to the offered payload size to probe the path MTU. Servers before SACK send no
+    // features (zero padding reads the same).
+    if ((payload_len != TRFTP_LEGACY_INFO_SIZE) && (payload_len < offsetof(TrftpInfo, features)))
+    {
+        terr << ClientLog() << "Invalid message length for <INFO>. Discarding..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if ((payload_len > TRFTP_LEGACY_INFO_SIZE) && (info.payload_size < TRFTP_MIN_PAYLOAD_SIZE))
+    {
+        terr << ClientLog() << "Payload size (" << info.payload_size << ") is too small. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+
+    if (new_file_version_ != info.new_file_version)
+    {
+        terr << ClientLog() << "File version mismatch. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    server_features_ = (payload_len >= offsetof(TrftpInfo, delta_length)) ? info.features : 0U;
+    new_file_size_ = ((payload_len >= sizeof(TrftpInfo)) && (server_features_ & TRFTP_FEATURE_LARGE_FILE))
+                         ? info.large_file_length
+                         : info.file_length;
+    if (new_file_size_ == 0)
+    {
+        terr << ClientLog() << "File size is zero. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+
+    status_ = FtpStatus::INFO;
+    new_file_crc32_ = info.crc32;
+    rtt_.AddSample(request_sent_time_, rx_time);
+
+    // Take the largest payload both sides and the local route support. Older servers always use the default.
+    legacy_server_ = (payload_len == TRFTP_LEGACY_INFO_SIZE);
+    selective_ack_ = server_features_ & TRFTP_FEATURE_SACK;
+    payload_size_ = TRFTP_PAYLOAD_SIZE;
+    if (!legacy_server_)
+    {
+        payload_size_ = std::min(info.payload_size, max_payload_size_);
+        if (auto mtu = UdpSocket::PathMtu(addr); mtu > TRFTP_PACKET_OVERHEAD + TRFTP_MIN_PAYLOAD_SIZE)
+        {
+            payload_size_ = std::min(payload_size_, mtu - TRFTP_PACKET_OVERHEAD);
+        }
+    }
+
+    // DATA to a group is sent once for every receiver, at the payload size offered
+    if ((server_features_ & TRFTP_FEATURE_MULTICAST) && (payload_size_ != info.payload_size))
+    {
+        terr << ClientLog() << "Cannot take the group's payload size (" << info.payload_size << "). Cancelling..."
+             << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if ((new_file_size_ + payload_size_ - 1) / payload_size_ > std::numeric_limits<std::uint32_t>::max())
+    {
+        terr << ClientLog() << "File size (" << new_file_size_ << ") is too large. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+
+    // A delta is only of use against the file we hold, which the final CRC32 check confirms in any case
+    delta_length_ = 0;
+    if ((payload_len >= offsetof(TrftpInfo, compressed_length)) && (info.delta_length > 0) && !delta_rejected_ &&
+        ((cur_file_crc32_ == 0) || (cur_file_crc32_ == info.delta_base_crc32)))
+    {
+        std::error_code ec;
+        if (auto size = std::filesystem::file_size(new_file_path_, ec); !ec && (size == info.delta_base_length))
+        {
+            delta_length_ = info.delta_length;
+        }
+    }
+
+    // The compressed file is taken instead of the whole one, a delta is smaller still
+    compressed_length_ = 0;
+    if ((payload_len >= offsetof(TrftpInfo, bundle_files)) && (info.compressed_length > 0) && compression_ &&
+        (delta_length_ == 0))
+    {
+        compressed_length_ = info.compressed_length;
+    }
+    data_length_ = (delta_length_ > 0)        ? delta_length_
+                   : (compressed_length_ > 0) ? compressed_length_
+                                              : new_file_size_;
+    bundle_files_ =
+        ((payload_len >= offsetof(TrftpInfo, large_file_length)) && (server_features_ & TRFTP_FEATURE_BUNDLE))
+            ? info.bundle_files
+            : 0U;
+
+    // An interrupted transfer of the same file goes on at the payload size its PSNs were counted in
+    std::vector<bool> held_psns;
+    auto resume = LoadResumeState(held_psns);
+
+    total_packet_number_ = static_cast<std::uint32_t>((data_length_ + payload_size_ - 1) / payload_size_);
+    received_psns_.assign(selective_ack_ ? total_packet_number_ : 0, false);
+
+    // Unless configured, buffer a full receive batch plus RECV_BUFFER_LATENCY worth of DATA at the gap requested in
+    // RDY, which is where the server's pacing starts. The buffer grows with the rate DATA actually arrives at.
+    receive_window_ = receive_buffer_size_ / (sizeof(TrftpHeader) + payload_size_);
+    receive_buffer_packets_ = 0;
+    if (receive_buffer_size_ == 0)
+    {
+        GrowReceiveBuffer(RECV_BATCH_SIZE + RECV_BUFFER_LATENCY / inter_packet_gap_);
+        rate_start_ = std::chrono::steady_clock::now();
+        rate_packets_ = 0;
+    }
+
+    // Keep no more DATA in flight than the socket buffer holds, and every hole within reach of one SACK
+    receive_window_ = selective_ack_ ? std::clamp(receive_window_, RECV_BATCH_SIZE, 8 * TRFTP_SACK_BITMAP_SIZE) : 0;
+    receive_drops_base_ = DataSocket().ReceiveDrops();
+
+    // FEC needs SACK to tell which packet a block lost, and a window of at least two blocks so the next block
+    // can arrive while a hole waits for its parity
+    fec_block_size_ = 0;
+    if (selective_ack_ && (server_features_ & TRFTP_FEATURE_FEC) && (max_fec_block_size_ > 0))
+    {
+        fec_block_size_ = std::max(std::min(max_fec_block_size_, receive_window_ / 2), TRFTP_FEC_MIN_BLOCK_SIZE);
+    }
+
+    if (resume && !new_file_sink_.Open(new_file_path_, new_file_size_, true))
+    {
+        terr << ClientLog() << "Partial file of the interrupted transfer is gone. Starting over..." << std::endl;
+        resume = false;
+    }
+    if (!resume && (bundle_files_ == 0) && !new_file_sink_.Open(new_file_path_, new_file_size_))
+    {
+        terr << ClientLog() << "Failed to open the file for writing. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if (std::error_code ec; (bundle_files_ > 0) && !std::filesystem::create_directories(new_file_path_, ec) &&
+                            !std::filesystem::is_directory(new_file_path_, ec))
+    {
+        terr << ClientLog() << "Failed to create the directory " << new_file_path_ << ". Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if (((data_length_ != new_file_size_) || (bundle_files_ > 0)) && !stream_sink_.Open(StreamPath(), data_length_))
+    {
+        terr << ClientLog() << "Failed to open the DATA stream for writing. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if ((compressed_length_ > 0) &&
+        !decompressor_.Start(stream_sink_.TempPath(), compressed_length_, new_file_sink_, new_file_size_))
+    {
+        terr << ClientLog() << "Failed to start decompressing. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if ((bundle_files_ > 0) && !bundle_extractor_.Start(stream_sink_.TempPath(), data_length_, bundle_files_,
+                                                        new_file_crc32_, new_file_path_))
+    {
+        terr << ClientLog() << "Failed to start extracting the directory. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if (delta_length_ > 0)
+    {
+        tout << ClientLog() << "Receiving a delta of " << delta_length_ << " bytes against version "
+             << cur_file_version_ << std::endl;
+    }
+    if (compressed_length_ > 0)
+    {
+        tout << ClientLog() << "Receiving the file compressed to " << compressed_length_ << " bytes" << std::endl;
+    }
+    if (bundle_files_ > 0)
+    {
+        tout << ClientLog() << "Receiving a directory of " << bundle_files_ << " files into " << new_file_path_
+             << std::endl;
+    }
+    if (resume)
+    {
+        RestoreReceived(std::move(held_psns));
+        tout << ClientLog() << "Resuming the transfer at PSN " << resume_psn_ << " of " << total_packet_number_
+             << std::endl;
+    }
+
+    // DATA the server sent ahead of a fast RDY is the whole file from PSN 0 at the offered payload size
+    speculative_data_ = fast_handshake_ && (payload_size_ == info.payload_size) && (data_length_ == new_file_size_) &&
+                        (resume_psn_ == 0);
+
+    SendMessage(MessageId::RDY);
+    if (selective_ack_)
+    {
+        reactor_.ArmTimer(sack_timer_, SackTimeout());
+    }
+}
+
+void ClientTransaction::MarkReceived(std::uint32_t psn)
+{
+    received_psns_[psn] = true;
+    highest_psn_ = std::max(highest_psn_, psn + 1);
+    while ((packet_sequence_number_ < total_packet_number_) && received_psns_[packet_sequence_number_])
+    {
+        packet_sequence_number_++;
+    }
+}
+
+bool ClientTransaction::UpdateFecBlock(std::uint32_t psn, const std::uint8_t *payload, std::size_t len, bool is_parity)
+{
+    const auto first_psn = psn - psn % fec_block_size_;
+    const auto end_psn = std::min(first_psn + fec_block_size_, total_packet_number_);
+
+    auto it = fec_blocks_.find(first_psn);
+    if (it == fec_blocks_.end())
+    {
+        // Parity of a block that is complete already (or a duplicate) has nothing left to rebuild
+        if (is_parity &&
+            std::all_of(received_psns_.begin() + first_psn, received_psns_.begin() + end_psn, [](bool b) { return b; }))
+        {
+            return true;
+        }
+
+        it = fec_blocks_.emplace(first_psn, FecBlock{ std::vector<std::uint8_t>(payload_size_, 0U), 0, false }).first;
+    }
+
+    auto &block = it->second;
+    if (is_parity && block.has_parity)
+    {
+        return true;
+    }
+    CalculateParity(block.parity.data(), payload, len);
+    if (is_parity)
+    {
+        block.has_parity = true;
+    }
+    else
+    {
+        block.received++;
+    }
+
+    // With the parity and all but one packet, what remains of the parity is the missing packet
+    if (block.has_parity && (block.received + 1 == end_psn - first_psn))
+    {
+        auto lost_psn = first_psn;
+        while (received_psns_[lost_psn])
+        {
+            lost_psn++;
+        }
 
-bool ClientTransaction::IsAlive() const
-{
-    return is_active_;
-}
+        const auto lost_len = (lost_psn == total_packet_number_ - 1)
+                                  ? (data_length_ - std::uint64_t(lost_psn) * payload_size_)
+                                  : payload_size_;
+        tout << ClientLog() << "Rebuilt DATA (psn=" << lost_psn << ") from parity" << std::endl;
 
-void ClientTransaction::Begin(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr)
-{
-    const auto &id = MessageId(msg.header.xid);
-    id == MessageId::NTF ? is_active_ = true : is_active_ = false;
+        // The block is released right away, so its write must not stay queued
+        if (!DataSink().Write(std::uint64_t(lost_psn) * payload_size_, block.parity.data(), lost_len) ||
+            !DataSink().Flush())
+        {
+            return false;
+        }
 
-    if (is_active_)
+        MarkReceived(lost_psn);
+        block.received++;
+    }
+
+    if (block.received == end_psn - first_psn)
     {
-        Reset();
-        OnReceive(msg, len, addr);
+        fec_blocks_.erase(it);
     }
+
+    return true;
 }
 
-void ClientTransaction::Reset()
+void ClientTransaction::FinishTransfer()
 {
-    server_address_ = {};
-    total_packet_number_ = 0;
-    packet_sequence_number_ = 0;
-    new_file_stream_.close();
-    new_file_path_ = std::filesystem::temp_directory_path() / "trftp_temp_file";
-    new_file_version_ = 0;
-    new_file_size_ = 0;
-    new_file_crc32_ = 0;
+    if (!DataSink().Flush())
+    {
+        terr << ClientLog() << "Failed to write to the file. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if ((delta_length_ > 0) && !ApplyDelta())
+    {
+        terr << ClientLog() << "Failed to rebuild the file from the delta. Cancelling..." << std::endl;
+        delta_rejected_ = true;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if ((compressed_length_ > 0) && !decompressor_.Finish())
+    {
+        terr << ClientLog() << "Failed to decompress the file. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    if (bundle_files_ > 0)
+    {
+        // Every file of the directory has been checked against the CRC32 that follows it in the stream already
+        if (!bundle_extractor_.Finish())
+        {
+            terr << ClientLog() << "Failed to extract the directory. Cancelling..." << std::endl;
+            SendMessage(MessageId::CXL);
+            return;
+        }
+        stream_sink_.Discard();
+    }
+    else if (new_file_size_ != std::filesystem::file_size(new_file_sink_.TempPath()))
+    {
+        terr << ClientLog() << "File size mismatch. Cancelling..." << std::endl;
+        SendMessage(MessageId::CXL);
+        return;
+    }
+    else if (std::uint32_t crc32 = 0U; !new_file_sink_.Checksum(crc32) || (new_file_crc32_ != crc32))
+    {
+        terr << ClientLog() << "CRC32 mismatch. Cancelling..." << std::endl;
+        delta_rejected_ = delta_rejected_ || (delta_length_ > 0);
+        SendMessage(MessageId::CXL);
+        return;
+    }
 
-    if (thread_.joinable())
+    if (auto drops = DataSocket().ReceiveDrops() - receive_drops_base_; drops > 0)
     {
-        thread_.join();
+        tout << ClientLog() << "Kernel dropped " << drops << " DATA datagrams (receive buffer full)" << std::endl;
     }
+
+    SendMessage(MessageId::DONE);
 }
 
-void ClientTransaction::HandleIncomingMessages()
+void ClientTransaction::SuspendTransfer()
 {
-    while (is_active_)
+    // Only DATA acknowledged with SACK can be resumed past its first hole, and only the whole file
+    if (!resumable_ || !selective_ack_ || !(server_features_ & TRFTP_FEATURE_RESUME) || !new_file_sink_.IsOpen() ||
+        (highest_psn_ == 0) || (data_length_ != new_file_size_))
+    {
+        return;
+    }
+
+    if (!new_file_sink_.Suspend())
     {
-        TrftpMessage msg;
-        sockaddr_in server_addr;
+        terr << ClientLog() << "Failed to keep the partial file. The next transfer starts over..." << std::endl;
+        return;
+    }
 
-        auto len = udp_socket_.Receive(msg, server_addr);
-        if (len == 0)
+    ResumeState state{ RECV_RESUME_MAGIC, new_file_version_, new_file_size_, new_file_crc32_, payload_size_,
+                       total_packet_number_ };
+    std::vector<std::uint8_t> bitmap((total_packet_number_ + 7) / 8, 0U);
+    for (std::uint32_t psn = 0; psn < total_packet_number_; psn++)
+    {
+        if (received_psns_[psn])
         {
-            terr << ClientLog() << "Timeout occurred. Cancelling..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
+            bitmap[psn / 8] |= 1U << (psn % 8);
         }
+    }
 
-        OnReceive(msg, len, server_addr);
+    std::ofstream ofs(ResumeStatePath(), std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char *>(&state), sizeof(state));
+    ofs.write(reinterpret_cast<const char *>(bitmap.data()), bitmap.size());
+    if (!ofs.flush())
+    {
+        terr << ClientLog() << "Failed to save the resume state. The next transfer starts over..." << std::endl;
+        return;
     }
+
+    tout << ClientLog() << "Suspended the transfer with " << packet_sequence_number_ << " of " << total_packet_number_
+         << " DATA packets in order" << std::endl;
 }
 
-void ClientTransaction::OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr)
+bool ClientTransaction::LoadResumeState(std::vector<bool> &received_psns)
 {
-    server_address_ = addr;
-    PrintRecvLog(msg);
-
-    if (!ValidateMessageIntegrity(msg, len))
+    if (!resumable_ || !selective_ack_ || !(server_features_ & TRFTP_FEATURE_RESUME))
     {
-        terr << ClientLog() << "Message integrity check failed. Discarding..." << std::endl;
-        return;
+        return false;
     }
 
-    const auto &id = MessageId(msg.header.xid);
-    const auto &payload_len = len - sizeof(TrftpHeader);
+    // The state is used up either way, the next suspension writes it anew
+    const auto state_path = ResumeStatePath();
+    std::ifstream ifs(state_path, std::ios::binary);
+    if (!ifs)
+    {
+        return false;
+    }
 
-    switch (id)
+    ResumeState state{};
+    std::vector<std::uint8_t> bitmap;
+    if (ifs.read(reinterpret_cast<char *>(&state), sizeof(state)))
     {
-    case MessageId::NTF:
-        if (payload_len != sizeof(TrftpNtf))
-        {
-            terr << ClientLog() << "Invalid message length for <CHK>. Discarding..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
-        }
+        bitmap.resize((std::uint64_t(state.total_packet_number) + 7) / 8);
+        ifs.read(reinterpret_cast<char *>(bitmap.data()), bitmap.size());
+    }
+    const auto complete = bool(ifs);
+    ifs.close();
 
-        status_ = id;
-        new_file_version_ = msg.ntf.new_file_version;
+    std::error_code ec;
+    std::filesystem::remove(state_path, ec);
+    if (data_length_ != new_file_size_)
+    {
+        return false;
+    }
 
-        if (thread_.joinable())
-        {
-            thread_.join();
-        }
-        thread_ = std::thread(&ClientTransaction::HandleIncomingMessages, this);
-        SendMessage(MessageId::CHK);
-        break;
+    // A newer version (or a rebuilt one) has nothing in common with the partial file
+    if (!complete || (state.magic != RECV_RESUME_MAGIC) || (state.new_file_version != new_file_version_) ||
+        (state.file_length != new_file_size_) || (state.crc32 != new_file_crc32_) ||
+        (state.payload_size < TRFTP_MIN_PAYLOAD_SIZE) || (state.payload_size > payload_size_) ||
+        (state.total_packet_number != (new_file_size_ + state.payload_size - 1) / state.payload_size))
+    {
+        return false;
+    }
 
-    case MessageId::INFO:
-        if (status_ != FtpStatus::CHK)
-        {
-            terr << ClientLog() << "Transaction state is not <CHK>. Discarding..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
-        }
-        if (payload_len != sizeof(TrftpInfo))
-        {
-            terr << ClientLog() << "Invalid message length for <INFO>. Discarding..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
-        }
+    payload_size_ = state.payload_size;
+    received_psns.assign(state.total_packet_number, false);
+    for (std::uint32_t psn = 0; psn < state.total_packet_number; psn++)
+    {
+        received_psns[psn] = bitmap[psn / 8] & (1U << (psn % 8));
+    }
 
-        if (new_file_version_ != msg.info.new_file_version)
-        {
-            terr << ClientLog() << "File version mismatch. Cancelling..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
-        }
-        if (msg.info.file_length == 0)
-        {
-            terr << ClientLog() << "File size is zero. Cancelling..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
-        }
+    return true;
+}
 
-        status_ = id;
-        new_file_size_ = msg.info.file_length;
-        new_file_crc32_ = msg.info.crc32;
-        total_packet_number_ = (new_file_size_ + sizeof(TrftpMessage::payload) - 1) / sizeof(TrftpMessage::payload);
+void ClientTransaction::RestoreReceived(std::vector<bool> &&received_psns)
+{
+    received_psns_ = std::move(received_psns);
 
-        new_file_stream_.open(new_file_path_, std::ios::binary | std::ios::out);
-        if (!new_file_stream_.is_open())
-        {
-            terr << ClientLog() << "Failed to open the file for writing. Cancelling..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
-        }
+    // DATA starts at the first hole, with FEC at the start of its block, since the parity of a block only adds up
+    // over all of its packets
+    auto first_hole = std::find(received_psns_.begin(), received_psns_.end(), false) - received_psns_.begin();
+    if (fec_block_size_ > 0)
+    {
+        first_hole -= first_hole % fec_block_size_;
+    }
 
-        SendMessage(MessageId::RDY);
-        break;
+    // DATA has to carry at least one packet for the transfer to finish
+    resume_psn_ = std::min(std::uint32_t(first_hole), total_packet_number_ - 1);
+    received_psns_[resume_psn_] = false;
 
-    case MessageId::DATA:
-        if (msg.header.psn == 0) // 첫번째 DATA 패킷
-        {
-            if (status_ != FtpStatus::RDY)
-            {
-                terr << ClientLog() << "Transaction state is not <INFO>. Discarding..." << std::endl;
-                SendMessage(MessageId::CXL);
-                break;
-            }
-            if (payload_len != sizeof(TrftpData))
-            {
-                terr << ClientLog() << "Invalid message length for <DATA>. Discarding..." << std::endl;
-                SendMessage(MessageId::CXL);
-                break;
-            }
-        }
-        else if (msg.header.psn < (msg.header.tpn - 1)) // 중간 DATA 패킷
-        {
-            if (status_ != FtpStatus::DATA)
-            {
-                terr << ClientLog() << "Transaction state is not <DATA>. Discarding..." << std::endl;
-                SendMessage(MessageId::CXL);
-                break;
-            }
-            if (payload_len != sizeof(TrftpData))
-            {
-                // print if specific environment variable is set
-                terr << ClientLog() << "Invalid message length for <DATA>. Discarding..." << std::endl;
-                SendMessage(MessageId::CXL);
-                break;
-            }
-        }
-        else // 마지막 DATA 패킷
+    // Past it, the server skips the packets RDY lists as held, which reaches further than any receive window took
+    // DATA before the transfer was interrupted. Any other packet is sent again, and a copy of a held one is dropped.
+    // With FEC, only whole blocks are held, the others are received again in full along with their parity. Older
+    // servers send everything from the first hole on.
+    if (fec_block_size_ > 0)
+    {
+        const auto held_end_psn = (server_features_ & TRFTP_FEATURE_HELD_PSNS)
+                                      ? std::min(resume_psn_ + 8 * TRFTP_SACK_BITMAP_SIZE, total_packet_number_)
+                                      : resume_psn_;
+        for (auto psn = resume_psn_; psn < total_packet_number_; psn += fec_block_size_)
         {
-            if (status_ != FtpStatus::DATA)
-            {
-                terr << ClientLog() << "Transaction state is not <DATA>. Discarding..." << std::endl;
-                SendMessage(MessageId::CXL);
-                break;
-            }
-            if (payload_len != (new_file_size_ % sizeof(TrftpMessage::payload)))
+            const auto first = received_psns_.begin() + psn;
+            const auto last = received_psns_.begin() + std::min(psn + fec_block_size_, total_packet_number_);
+            if ((psn + fec_block_size_ > held_end_psn) || !std::all_of(first, last, [](bool b) { return b; }))
             {
-                terr << ClientLog() << "Invalid message length for <DATA>. Discarding..." << std::endl;
-                SendMessage(MessageId::CXL);
-                break;
+                std::fill(first, last, false);
             }
         }
+    }
 
-        if (msg.header.psn != packet_sequence_number_)
-        {
-            terr << ClientLog() << "PSN mismatch. Retransmitting..." << std::endl;
-            SendMessage(MessageId::RTX);
-            return;
-        }
+    packet_sequence_number_ = resume_psn_;
+    highest_psn_ = resume_psn_;
+    sack_reported_psn_ = resume_psn_;
+    sack_acked_psn_ = resume_psn_;
+}
+
+bool ClientTransaction::ApplyDelta()
+{
+    std::ifstream delta(stream_sink_.TempPath(), std::ios::binary);
+    std::ifstream base(new_file_path_, std::ios::binary);
+    if (!delta || !base)
+    {
+        return false;
+    }
 
-        new_file_stream_.write(msg.data.new_file_data, payload_len);
-        if (new_file_stream_.fail())
+    // Every operation rebuilds the next bytes of the file, from the delta itself or from the file we hold
+    std::vector<char> buf(RECV_DELTA_CHUNK_SIZE);
+    std::uint64_t file_offset = 0;
+    TrftpDeltaOp op;
+    while (delta.read(reinterpret_cast<char *>(&op), sizeof(op)))
+    {
+        auto &src = (op.offset == TRFTP_DELTA_LITERAL) ? delta : base;
+        if ((file_offset + op.length > new_file_size_) || ((&src == &base) && !base.seekg(op.offset)))
         {
-            terr << ClientLog() << "Failed to write to the file. Cancelling..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
+            return false;
         }
 
-        status_ = id;
-        packet_sequence_number_++;
-
-        if (packet_sequence_number_ == total_packet_number_) // 마지막 패킷까지 수신 완료
+        for (std::size_t left = op.length; left > 0;)
         {
-            new_file_stream_.close();
-
-            if (new_file_size_ != std::filesystem::file_size(new_file_path_))
-            {
-                terr << ClientLog() << "File size mismatch. Cancelling..." << std::endl;
-                SendMessage(MessageId::CXL);
-                break;
-            }
-            if (new_file_crc32_ != CalculateFileCrc32(new_file_path_))
+            const auto len = std::min(left, buf.size());
+            if (!src.read(buf.data(), len) || !new_file_sink_.Write(file_offset, buf.data(), len) ||
+                !new_file_sink_.Flush())
             {
-                terr << ClientLog() << "CRC32 mismatch. Cancelling..." << std::endl;
-                SendMessage(MessageId::CXL);
-                break;
+                return false;
             }
 
-            SendMessage(MessageId::DONE);
+            file_offset += len;
+            left -= len;
         }
+    }
 
-        break;
+    // The delta has to end on an operation and rebuild the file to its last byte
+    if ((delta.gcount() != 0) || (file_offset != new_file_size_))
+    {
+        return false;
+    }
 
-    case MessageId::FIN:
-        if (status_ != FtpStatus::DONE)
-        {
-            terr << ClientLog() << "Transaction state is not <DONE>. Discarding..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
-        }
-        if (payload_len != 0)
-        {
-            terr << ClientLog() << "Invalid message length for <FIN>. Discarding..." << std::endl;
-            SendMessage(MessageId::CXL);
-            break;
-        }
+    stream_sink_.Discard();
+    return true;
+}
 
-        status_ = id;
-        is_active_ = false;
+FileSink &ClientTransaction::DataSink()
+{
+    return ((data_length_ != new_file_size_) || (bundle_files_ > 0)) ? stream_sink_ : new_file_sink_;
+}
+
+void ClientTransaction::ReportExtractedFiles()
+{
+    for (const auto &file_path : bundle_extractor_.TakeExtracted())
+    {
         if (client_)
         {
-            client_->OnFileReceived(new_file_path_, new_file_version_);
+            client_->OnFileReceived(file_path, new_file_version_);
         }
-        break;
+    }
+}
 
-    case MessageId::CXL:
-        if (new_file_stream_.is_open())
-        {
-            new_file_stream_.close();
-            std::filesystem::remove(new_file_path_);
-        }
+UdpSocket &ClientTransaction::DataSocket()
+{
+    return multicast_ ? *group_socket_ : udp_socket_;
+}
 
-        status_ = id;
-        SendMessage(MessageId::CXL);
-        break;
+std::filesystem::path ClientTransaction::StreamPath() const
+{
+    auto stream_path = new_file_path_;
+    stream_path += ".trftp-stream";
+    return stream_path;
+}
 
-    default:
-        break;
-    }
+std::filesystem::path ClientTransaction::ResumeStatePath() const
+{
+    auto state_path = new_file_path_;
+    state_path += ".trftp-resume";
+    return state_path;
 }
 
 void ClientTransaction::SendMessage(MessageId id)
 {
-    if ((id != MessageId::CHK) && (id != MessageId::RDY) && (id != MessageId::RTX) && (id != MessageId::DONE) &&
-        (id != MessageId::CXL))
+    if ((id != MessageId::CHK) && (id != MessageId::RDY) && (id != MessageId::RTX) && (id != MessageId::SACK) &&
+        (id != MessageId::DONE) && (id != MessageId::CXL))
     {
         terr << ClientLog() << "Unknown XID (" << static_cast<std::uint32_t>(id) << "). Discarding..." << std::endl;
         return;
@@ -308,29 +1205,104 @@ void ClientTransaction::SendMessage(MessageId id)
 
     case MessageId::RDY:
         status_ = id;
-        payload_len += sizeof(TrftpRdy);
+        // Servers take RDY only up to the last field they know of
+        payload_len += legacy_server_                                   ? TRFTP_LEGACY_RDY_SIZE
+                       : fast_handshake_                                ? offsetof(TrftpRdy, held_psns)
+                       : (server_features_ & TRFTP_FEATURE_LARGE_FILE)  ? offsetof(TrftpRdy, cur_file_version)
+                       : (server_features_ & TRFTP_FEATURE_BUNDLE)      ? offsetof(TrftpRdy, large_file_length)
+                       : (server_features_ & TRFTP_FEATURE_COMPRESSION) ? offsetof(TrftpRdy, bundle_files)
+                       : (server_features_ & TRFTP_FEATURE_DELTA)       ? offsetof(TrftpRdy, compressed_length)
+                       : (server_features_ & TRFTP_FEATURE_RESUME)      ? offsetof(TrftpRdy, delta_length)
+                       : (server_features_ & TRFTP_FEATURE_FEC)         ? offsetof(TrftpRdy, resume_psn)
+                       : selective_ack_                                 ? offsetof(TrftpRdy, fec_block_size)
+                                                                        : offsetof(TrftpRdy, receive_window);
         msg.rdy.new_file_version = new_file_version_;
-        msg.rdy.file_length = new_file_size_;
+        // The 32-bit length saturates for files of 4 GiB and more, which the 64-bit one carries in full
+        msg.rdy.file_length = static_cast<std::uint32_t>(std::min<std::uint64_t>(new_file_size_, TRFTP_LENGTH_LARGE));
         msg.rdy.inter_packet_gap = inter_packet_gap_.count();
+        msg.rdy.payload_size = payload_size_;
+        msg.rdy.receive_window = receive_window_;
+        msg.rdy.fec_block_size = fec_block_size_;
+        msg.rdy.resume_psn = resume_psn_;
+        msg.rdy.delta_length = delta_length_;
+        msg.rdy.compressed_length = compressed_length_;
+        msg.rdy.bundle_files = bundle_files_;
+        msg.rdy.large_file_length = new_file_size_;
+        msg.rdy.cur_file_version = cur_file_version_;
+
+        // A resumed transfer lists the packets it holds past resume_psn, up to the last one
+        if ((server_features_ & TRFTP_FEATURE_HELD_PSNS) && (resume_psn_ < received_psns_.size()))
+        {
+            const auto held_bits =
+                std::min<std::size_t>(8 * TRFTP_SACK_BITMAP_SIZE, received_psns_.size() - resume_psn_);
+            std::size_t held_len = 0;
+            std::fill(msg.rdy.held_psns, msg.rdy.held_psns + (held_bits + 7) / 8, 0U);
+            for (std::size_t i = 0; i < held_bits; i++)
+            {
+                if (received_psns_[resume_psn_ + i])
+                {
+                    msg.rdy.held_psns[i / 8] |= 1U << (i % 8);
+                    held_len = i / 8 + 1;
+                }
+            }
+            if (held_len > 0)
+            {
+                payload_len = offsetof(TrftpRdy, held_psns) + held_len;
+            }
+        }
         break;
 
     case MessageId::DONE:
         status_ = id;
-        payload_len += sizeof(TrftpDone);
+        payload_len += (server_features_ & TRFTP_FEATURE_LARGE_FILE) ? sizeof(TrftpDone) : TRFTP_LEGACY_DONE_SIZE;
         msg.done.new_file_version = new_file_version_;
-        msg.done.file_length = new_file_size_;
+        msg.done.file_length = static_cast<std::uint32_t>(std::min<std::uint64_t>(new_file_size_, TRFTP_LENGTH_LARGE));
+        msg.done.large_file_length = new_file_size_;
         msg.done.crc32 = new_file_crc32_;
         break;
 
     case MessageId::CXL:
         status_ = id;
         is_active_ = false;
+        decompressor_.Stop();
+        bundle_extractor_.Stop();
+        stream_sink_.Discard();
+        new_file_sink_.Discard();
         break;
 
     case MessageId::RTX:
-        payload_len += sizeof(TrftpRtx);
+        payload_len += legacy_server_ ? TRFTP_LEGACY_RTX_SIZE : sizeof(TrftpRtx);
         msg.rtx.retransmit_psn = packet_sequence_number_;
+        msg.rtx.receive_drops = DataSocket().ReceiveDrops() - receive_drops_base_;
+        break;
+
+    case MessageId::SACK:
+    {
+        // Acknowledge every PSN below base_psn and request the holes in [sack_from_psn_, sack_end_psn_) that the
+        // bitmap reaches
+        const auto base_psn = packet_sequence_number_.load();
+        const auto end_psn = std::clamp(sack_end_psn_, base_psn, base_psn + 8 * TRFTP_SACK_BITMAP_SIZE);
+
+        msg.sack.base_psn = base_psn;
+        msg.sack.receive_drops = DataSocket().ReceiveDrops() - receive_drops_base_;
+        msg.sack.receive_window = receive_window_;
+        msg.sack.bitmap_bits = end_psn - base_psn;
+        payload_len += offsetof(TrftpSack, bitmap) + (msg.sack.bitmap_bits + 7) / 8;
+        std::fill(msg.sack.bitmap, msg.sack.bitmap + (msg.sack.bitmap_bits + 7) / 8, 0U);
+
+        for (auto psn = std::max(sack_from_psn_, base_psn); psn < end_psn; psn++)
+        {
+            if (!received_psns_[psn])
+            {
+                msg.sack.bitmap[(psn - base_psn) / 8] |= 1U << ((psn - base_psn) % 8);
+            }
+        }
+
+        // A lost tail reported on silence may still turn into holes that have to be reported once they appear
+        sack_reported_psn_ = std::max(sack_reported_psn_, std::min(end_psn, highest_psn_));
+        sack_acked_psn_ = base_psn;
         break;
+    }
 
     default:
         return;
@@ -348,13 +1320,30 @@ void ClientTransaction::SendMessage(MessageId id)
     msg.header.crc32 = 0U;
     msg.header.crc32 = CalculateCrc32(reinterpret_cast<std::uint8_t *>(&msg), sizeof(TrftpHeader) + payload_len, 0U);
 
-    // Send the message
-    if (udp_socket_.Send(msg, sizeof(TrftpHeader) + payload_len, server_address_))
+    // Send the message, remembering when requests left so their replies give an RTT sample
+    Timestamp tx_time;
+    if (udp_socket_.Send(msg, sizeof(TrftpHeader) + payload_len, server_address_, &tx_time))
     {
+        // DATA sent ahead may follow a fast RDY at once, so it gives no sample
+        if ((id == MessageId::CHK) || ((id == MessageId::RDY) && !fast_handshake_))
+        {
+            request_sent_time_ = tx_time;
+        }
+
         PrintSendLog(msg);
     }
 }
 
+std::chrono::microseconds ClientTransaction::ReceiveTimeout() const
+{
+    return std::chrono::ceil<std::chrono::microseconds>(rtt_.Timeout(RECV_TIMEOUT, RECV_TIMEOUT_MAX));
+}
+
+std::chrono::microseconds ClientTransaction::SackTimeout() const
+{
+    return std::chrono::ceil<std::chrono::microseconds>(rtt_.Timeout(RECV_SACK_TIMEOUT, RECV_TIMEOUT));
+}
+
 bool ClientTransaction::ValidateMessageIntegrity(const TrftpMessage &msg, std::size_t len) const
 {
     // 1. check the CRC32
@@ -410,6 +1399,9 @@ void ClientTransaction::PrintRecvLog(const TrftpMessage &msg) const
     case MessageId::DATA:
         id_str = "DATA";
         break;
+    case MessageId::FEC:
+        id_str = "FEC";
+        break;
     case MessageId::FIN:
         id_str = "FIN";
         break;
@@ -443,6 +1435,9 @@ void ClientTransaction::PrintSendLog(const TrftpMessage &msg) const
     case MessageId::RTX:
         id_str = "RTX";
         break;
+    case MessageId::SACK:
+        id_str = "SACK";
+        break;
     case MessageId::DONE:
         id_str = "DONE";
         break;
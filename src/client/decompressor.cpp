@@ -0,0 +1,178 @@
+#include "trftp/client/decompressor.h"
+
+namespace trftp
+{
+
+Decompressor::Decompressor()
+    : fd_{ -1 }
+    , sink_{ nullptr }
+    , stream_length_{ 0 }
+    , raw_length_{ 0 }
+    , succeeded_{ false }
+    , mtx_{}
+    , cv_{}
+    , thr_{}
+    , received_length_{ 0 }
+    , stopping_{ false }
+{
+}
+
+Decompressor::~Decompressor()
+{
+    Stop();
+}
+
+bool Decompressor::Start(const std::filesystem::path &stream_path, std::uint64_t stream_length, FileSink &sink,
+                         std::uint64_t raw_length)
+{
+    Stop();
+
+    fd_ = open(stream_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    sink_ = &sink;
+    stream_length_ = stream_length;
+    raw_length_ = raw_length;
+    succeeded_ = false;
+    received_length_ = 0;
+    stopping_ = false;
+    thr_ = std::thread(&Decompressor::Run, this);
+    return true;
+}
+
+void Decompressor::Advance(std::uint64_t received_length)
+{
+    if (!thr_.joinable())
+    {
+        return;
+    }
+
+    {
+        std::scoped_lock lock(mtx_);
+        if (received_length <= received_length_)
+        {
+            return;
+        }
+        received_length_ = received_length;
+    }
+    cv_.notify_one();
+}
+
+bool Decompressor::Finish()
+{
+    if (!thr_.joinable())
+    {
+        return false;
+    }
+
+    Advance(stream_length_);
+    thr_.join();
+
+    const auto succeeded = succeeded_;
+    Stop();
+    return succeeded;
+}
+
+void Decompressor::Stop()
+{
+    if (thr_.joinable())
+    {
+        {
+            std::scoped_lock lock(mtx_);
+            stopping_ = true;
+        }
+        cv_.notify_one();
+        thr_.join();
+    }
+
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+    sink_ = nullptr;
+}
+
+void Decompressor::Run()
+{
+    std::vector<std::uint8_t> src(TRFTP_COMPRESSION_BLOCK_SIZE);
+    std::vector<std::uint8_t> raw(TRFTP_COMPRESSION_BLOCK_SIZE);
+    std::uint64_t stream_offset = 0;
+    std::uint64_t raw_offset = 0;
+
+    while (stream_offset < stream_length_)
+    {
+        // Wait for the block header, then for the whole block
+        TrftpCompressedBlock block{};
+        for (auto needed = stream_offset + sizeof(block);;)
+        {
+            if (needed > stream_length_)
+            {
+                return;
+            }
+
+            std::unique_lock lock(mtx_);
+            cv_.wait(lock, [&]() { return stopping_ || (received_length_ >= needed); });
+            if (stopping_)
+            {
+                return;
+            }
+            lock.unlock();
+
+            if (needed > stream_offset + sizeof(block))
+            {
+                break;
+            }
+            if (!ReadStream(stream_offset, &block, sizeof(block)) || (block.raw_length == 0) ||
+                (block.raw_length > TRFTP_COMPRESSION_BLOCK_SIZE) || (block.compressed_length == 0) ||
+                (block.compressed_length > block.raw_length) || (raw_offset + block.raw_length > raw_length_))
+            {
+                return;
+            }
+            needed += block.compressed_length;
+        }
+
+        // Blocks that did not compress are stored as they are
+        if (!ReadStream(stream_offset + sizeof(block), src.data(), block.compressed_length))
+        {
+            return;
+        }
+        const auto stored = (block.compressed_length == block.raw_length);
+        if (!stored && !DecompressBlock(src.data(), block.compressed_length, raw.data(), block.raw_length))
+        {
+            return;
+        }
+        if (!sink_->Write(raw_offset, stored ? src.data() : raw.data(), block.raw_length) || !sink_->Flush())
+        {
+            return;
+        }
+
+        stream_offset += sizeof(block) + block.compressed_length;
+        raw_offset += block.raw_length;
+    }
+
+    succeeded_ = (raw_offset == raw_length_);
+}
+
+bool Decompressor::ReadStream(std::uint64_t offset, void *buf, std::size_t len) const
+{
+    for (auto *dst = static_cast<std::uint8_t *>(buf); len > 0;)
+    {
+        auto n = pread(fd_, dst, len, offset);
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        dst += n;
+        offset += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+} // namespace trftp
@@ -0,0 +1,289 @@
+#include "trftp/client/file_sink.h"
+
+namespace trftp
+{
+
+FileSink::FileSink()
+    : fd_{ -1 }
+    , file_path_{}
+    , temp_path_{}
+    , ring_{ nullptr }
+    , pending_writes_{}
+{
+}
+
+FileSink::~FileSink()
+{
+    Discard();
+}
+
+bool FileSink::Open(const std::filesystem::path &file_path, std::uint64_t file_size, bool resume)
+{
+    Discard();
+
+    file_path_ = file_path;
+    temp_path_ = file_path;
+    temp_path_ += ".trftp-part";
+
+    // A resumed transfer goes on writing into the temporary file it was suspended with, which has to exist still
+    fd_ = open(temp_path_.c_str(), O_RDWR | O_CLOEXEC | (resume ? 0 : (O_CREAT | O_TRUNC)), 0644);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    // Reserve the whole file at once to avoid fragmentation. Fall back to a sparse file if not supported.
+    if (file_size > 0 && fallocate(fd_, 0, 0, file_size) < 0)
+    {
+        if ((errno != EOPNOTSUPP) || (ftruncate(fd_, file_size) < 0))
+        {
+            Discard();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FileSink::Write(std::uint64_t offset, const void *data, std::size_t len)
+{
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    if (ring_)
+    {
+        if (pending_writes_.size() >= ring_->Capacity() && !Flush())
+        {
+            return false;
+        }
+
+        ring_->PrepareWrite(fd_, data, len, offset, pending_writes_.size());
+        pending_writes_.push_back({ offset, data, len });
+        return true;
+    }
+
+    const auto *buf = static_cast<const std::uint8_t *>(data);
+    while (len > 0)
+    {
+        auto bytes_written = pwrite(fd_, buf, len, offset);
+        if (bytes_written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        buf += bytes_written;
+        offset += bytes_written;
+        len -= bytes_written;
+    }
+
+    return true;
+}
+
+bool FileSink::Flush()
+{
+    if (!ring_ || pending_writes_.empty())
+    {
+        return true;
+    }
+
+    // Submit every queued write with one io_uring_enter() and wait for all of them
+    auto writes = std::exchange(pending_writes_, {});
+    if (!ring_->Submit(writes.size()))
+    {
+        return false;
+    }
+
+    bool success = true;
+    std::uint64_t index = 0;
+    std::int32_t res = 0;
+    for (std::size_t reaped = 0; reaped < writes.size() && ring_->PopCompletion(index, res); reaped++)
+    {
+        auto &write = writes[index];
+        if (res < 0)
+        {
+            success = false;
+        }
+        else if (static_cast<std::size_t>(res) < write.len)
+        {
+            // Finish a short write synchronously
+            auto ring = std::exchange(ring_, nullptr);
+            success &= Write(write.offset + res, static_cast<const std::uint8_t *>(write.data) + res, write.len - res);
+            ring_ = std::move(ring);
+        }
+    }
+
+    return success;
+}
+
+bool FileSink::Checksum(std::uint32_t &crc32)
+{
+    struct stat st;
+    if ((fd_ < 0) || !Flush() || (fstat(fd_, &st) < 0))
+    {
+        return false;
+    }
+
+    // Without the ring one chunk is read at a time, with it SINK_READ_AHEAD chunks are read with one io_uring_enter()
+    const std::size_t ahead = ring_ ? std::min<std::size_t>(SINK_READ_AHEAD, ring_->Capacity()) : 1;
+    std::vector<std::uint8_t> buf(ahead * SINK_READ_CHUNK_SIZE);
+    const std::uint64_t file_size = st.st_size;
+    crc32 = 0U;
+    for (std::uint64_t offset = 0; offset < file_size;)
+    {
+        const auto len = std::min<std::uint64_t>(buf.size(), file_size - offset);
+        std::vector<std::int32_t> results((len + SINK_READ_CHUNK_SIZE - 1) / SINK_READ_CHUNK_SIZE, 0);
+        if (ring_)
+        {
+            for (std::size_t i = 0; i < results.size(); i++)
+            {
+                const auto chunk_len = std::min<std::uint64_t>(SINK_READ_CHUNK_SIZE, len - i * SINK_READ_CHUNK_SIZE);
+                ring_->PrepareRead(fd_, buf.data() + i * SINK_READ_CHUNK_SIZE, chunk_len,
+                                   offset + i * SINK_READ_CHUNK_SIZE, i);
+            }
+            if (!ring_->Submit(results.size()))
+            {
+                return false;
+            }
+
+            std::uint64_t index = 0;
+            std::int32_t res = 0;
+            for (std::size_t reaped = 0; reaped < results.size() && ring_->PopCompletion(index, res); reaped++)
+            {
+                results[index] = res;
+            }
+        }
+
+        // A chunk the ring did not read in full (or every chunk without it) is read synchronously
+        for (std::size_t i = 0; i < results.size(); i++)
+        {
+            const auto chunk_len = std::min<std::uint64_t>(SINK_READ_CHUNK_SIZE, len - i * SINK_READ_CHUNK_SIZE);
+            for (auto done = static_cast<std::uint64_t>(std::max(results[i], 0)); done < chunk_len;)
+            {
+                auto n = pread(fd_, buf.data() + i * SINK_READ_CHUNK_SIZE + done, chunk_len - done,
+                               offset + i * SINK_READ_CHUNK_SIZE + done);
+                if ((n < 0) && (errno == EINTR))
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    return false;
+                }
+                done += n;
+            }
+        }
+
+        crc32 = CalculateCrc32(buf.data(), len, crc32);
+        offset += len;
+    }
+
+    return true;
+}
+
+bool FileSink::Commit()
+{
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    if (!Flush() || (fdatasync(fd_) < 0) || (close(std::exchange(fd_, -1)) < 0))
+    {
+        Discard();
+        return false;
+    }
+
+    // Atomically replace the destination
+    if (std::rename(temp_path_.c_str(), file_path_.c_str()) < 0)
+    {
+        Discard();
+        return false;
+    }
+
+    temp_path_.clear();
+    return true;
+}
+
+bool FileSink::Suspend()
+{
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    // Written data must be on disk before anyone records it as received
+    auto success = Flush() && (fdatasync(fd_) == 0);
+    close(std::exchange(fd_, -1));
+    if (!success)
+    {
+        Discard();
+        return false;
+    }
+
+    temp_path_.clear();
+    return true;
+}
+
+void FileSink::Discard()
+{
+    if (fd_ >= 0)
+    {
+        // The kernel may still be reading from the queued buffers
+        std::ignore = Flush();
+        close(std::exchange(fd_, -1));
+    }
+
+    if (!temp_path_.empty())
+    {
+        std::error_code ec;
+        std::filesystem::remove(temp_path_, ec);
+        temp_path_.clear();
+    }
+}
+
+bool FileSink::SetIoBackend(IoBackend backend)
+{
+    if (!Flush())
+    {
+        return false;
+    }
+
+    if (backend == IoBackend::BLOCKING)
+    {
+        ring_.reset();
+        return true;
+    }
+
+    try
+    {
+        if (!ring_)
+        {
+            ring_ = std::make_unique<IoUring>();
+        }
+    }
+    catch (const std::runtime_error &)
+    {
+        // Not built in or refused by the kernel: keep using pwrite()
+        return false;
+    }
+
+    return true;
+}
+
+bool FileSink::IsOpen() const
+{
+    return fd_ >= 0;
+}
+
+const std::filesystem::path &FileSink::TempPath() const
+{
+    return temp_path_;
+}
+
+} // namespace trftp
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "trftp/compression.h"
+
+namespace trftp
+{
+
+static constexpr std::uint32_t HASH_BITS = 14;      // Positions remembered while looking for matches
+static constexpr std::size_t MIN_MATCH = 4;         // Shortest match worth a sequence
+static constexpr std::size_t LAST_LITERALS = 5;     // A block always ends in this many literals
+static constexpr std::size_t MATCH_END_MARGIN = 12; // No match starts this close to the end of a block
+static constexpr std::size_t MAX_OFFSET = 65535;    // Matches reach back at most this far
+
+static std::uint32_t Read32(const std::uint8_t *p)
+{
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Length nibbles of 15 go on in bytes of 255 and a final byte below 255
+static void PutLength(std::vector<std::uint8_t> &out, std::size_t len)
+{
+    for (; len >= 255; len -= 255)
+    {
+        out.push_back(255);
+    }
+    out.push_back(static_cast<std::uint8_t>(len));
+}
+
+static bool GetLength(const std::uint8_t *src, std::size_t len, std::size_t &ip, std::size_t &value)
+{
+    std::uint8_t byte;
+    do
+    {
+        if (ip >= len)
+        {
+            return false;
+        }
+        byte = src[ip++];
+        value += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+// Sequence of literals followed by a match (none for the last one): token, literal length, literals, offset, match
+// length
+static void PutSequence(std::vector<std::uint8_t> &out, const std::uint8_t *literals, std::size_t literal_len,
+                        std::size_t offset, std::size_t match_len)
+{
+    const auto match_code = (match_len > 0) ? match_len - MIN_MATCH : 0;
+    out.push_back(static_cast<std::uint8_t>((std::min<std::size_t>(literal_len, 15) << 4) |
+                                            std::min<std::size_t>(match_code, 15)));
+    if (literal_len >= 15)
+    {
+        PutLength(out, literal_len - 15);
+    }
+    out.insert(out.end(), literals, literals + literal_len);
+
+    if (match_len > 0)
+    {
+        out.push_back(static_cast<std::uint8_t>(offset));
+        out.push_back(static_cast<std::uint8_t>(offset >> 8));
+        if (match_code >= 15)
+        {
+            PutLength(out, match_code - 15);
+        }
+    }
+}
+
+static void CompressBlock(const std::uint8_t *src, std::size_t len, std::vector<std::uint8_t> &out)
+{
+    std::vector<std::uint32_t> table(1U << HASH_BITS, -1U);
+
+    std::size_t anchor = 0; // Start of the literals not emitted yet
+    std::size_t ip = 0;
+    while ((len > MATCH_END_MARGIN) && (ip < len - MATCH_END_MARGIN))
+    {
+        const auto sequence = Read32(src + ip);
+        const auto hash = (sequence * 2654435761U) >> (32 - HASH_BITS);
+        const auto ref = std::exchange(table[hash], static_cast<std::uint32_t>(ip));
+        if ((ref == -1U) || (ip - ref > MAX_OFFSET) || (Read32(src + ref) != sequence))
+        {
+            ip++;
+            continue;
+        }
+
+        auto match_len = MIN_MATCH;
+        while ((ip + match_len < len - LAST_LITERALS) && (src[ref + match_len] == src[ip + match_len]))
+        {
+            match_len++;
+        }
+
+        PutSequence(out, src + anchor, ip - anchor, ip - ref, match_len);
+        ip += match_len;
+        anchor = ip;
+    }
+
+    PutSequence(out, src + anchor, len - anchor, 0, 0);
+}
+
+std::vector<std::uint8_t> CompressStream(const std::uint8_t *data, std::size_t size)
+{
+    std::vector<std::uint8_t> stream;
+    std::vector<std::uint8_t> block;
+    stream.reserve(size / 2);
+
+    for (std::size_t offset = 0; offset < size; offset += TRFTP_COMPRESSION_BLOCK_SIZE)
+    {
+        const auto raw_len = std::min<std::size_t>(TRFTP_COMPRESSION_BLOCK_SIZE, size - offset);
+        block.clear();
+        CompressBlock(data + offset, raw_len, block);
+
+        const auto stored = block.size() >= raw_len;
+        const TrftpCompressedBlock header{ static_cast<std::uint32_t>(raw_len),
+                                           static_cast<std::uint32_t>(stored ? raw_len : block.size()) };
+        const auto *header_bytes = reinterpret_cast<const std::uint8_t *>(&header);
+        stream.insert(stream.end(), header_bytes, header_bytes + sizeof(header));
+        if (stored)
+        {
+            stream.insert(stream.end(), data + offset, data + offset + raw_len);
+        }
+        else
+        {
+            stream.insert(stream.end(), block.begin(), block.end());
+        }
+    }
+
+    return stream;
+}
+
+bool DecompressBlock(const std::uint8_t *src, std::size_t len, std::uint8_t *dst, std::size_t raw_len)
+{
+    // The data comes off the network, so every length and offset is checked before it is used
+    std::size_t ip = 0;
+    std::size_t op = 0;
+    while (ip < len)
+    {
+        const auto token = src[ip++];
+
+        std::size_t literal_len = token >> 4;
+        if ((literal_len == 15) && !GetLength(src, len, ip, literal_len))
+        {
+            return false;
+        }
+        if ((literal_len > len - ip) || (literal_len > raw_len - op))
+        {
+            return false;
+        }
+        std::memcpy(dst + op, src + ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+
+        if (ip == len) // The last sequence has no match
+        {
+            break;
+        }
+
+        if (len - ip < 2)
+        {
+            return false;
+        }
+        const std::size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+
+        std::size_t match_len = token & 0x0F;
+        if ((match_len == 15) && !GetLength(src, len, ip, match_len))
+        {
+            return false;
+        }
+        match_len += MIN_MATCH;
+        if ((offset == 0) || (offset > op) || (match_len > raw_len - op))
+        {
+            return false;
+        }
+
+        // Matches may overlap what they produce (e.g. runs), so copy byte by byte
+        for (std::size_t i = 0; i < match_len; i++, op++)
+        {
+            dst[op] = dst[op - offset];
+        }
+    }
+
+    return op == raw_len;
+}
+
+} // namespace trftp
@@ -0,0 +1,328 @@
+#include "trftp/io_uring.h"
+
+#ifdef TRFTP_HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace trftp
+{
+
+#ifdef TRFTP_HAVE_IO_URING
+
+IoUring::IoUring(unsigned entries)
+    : fd_{ -1 }
+    , entries_{ 0 }
+    , sq_ring_{ MAP_FAILED }
+    , cq_ring_{ MAP_FAILED }
+    , sqes_{ MAP_FAILED }
+    , sq_ring_size_{ 0 }
+    , cq_ring_size_{ 0 }
+    , sq_head_{ nullptr }
+    , sq_tail_{ nullptr }
+    , sq_mask_{ nullptr }
+    , sq_array_{ nullptr }
+    , sqe_tail_{ 0 }
+    , cq_head_{ nullptr }
+    , cq_tail_{ nullptr }
+    , cq_mask_{ nullptr }
+    , cqes_{ nullptr }
+{
+    io_uring_params params = {};
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[IoUring] io_uring_setup() failed. err=" + std::to_string(errno));
+    }
+
+    entries_ = params.sq_entries;
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // Both rings share one mapping on Linux 5.4+
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+    {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_
+                           : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                                  IORING_OFF_CQ_RING);
+    sqes_ = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 fd_, IORING_OFF_SQES);
+    if ((sq_ring_ == MAP_FAILED) || (cq_ring_ == MAP_FAILED) || (sqes_ == MAP_FAILED))
+    {
+        auto err = errno;
+        Release();
+        throw std::runtime_error("[IoUring] mmap() failed. err=" + std::to_string(err));
+    }
+
+    auto *sq = static_cast<std::uint8_t *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqe_tail_ = *sq_tail_;
+
+    auto *cq = static_cast<std::uint8_t *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = cq + params.cq_off.cqes;
+}
+
+IoUring::~IoUring()
+{
+    Release();
+}
+
+void IoUring::Release()
+{
+    if (sqes_ != MAP_FAILED)
+    {
+        munmap(sqes_, entries_ * sizeof(io_uring_sqe));
+    }
+    if ((cq_ring_ != MAP_FAILED) && (cq_ring_ != sq_ring_))
+    {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED)
+    {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+
+    sqes_ = cq_ring_ = sq_ring_ = MAP_FAILED;
+    fd_ = -1;
+}
+
+bool IoUring::IsSupported()
+{
+    try
+    {
+        IoUring ring(1);
+        return true;
+    }
+    catch (const std::runtime_error &)
+    {
+        return false;
+    }
+}
+
+unsigned IoUring::Capacity() const
+{
+    return entries_;
+}
+
+void *IoUring::GetSqe()
+{
+    auto head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sqe_tail_ - head >= entries_)
+    {
+        return nullptr;
+    }
+
+    auto index = sqe_tail_ & *sq_mask_;
+    sq_array_[index] = index;
+    sqe_tail_++;
+
+    auto *sqe = static_cast<io_uring_sqe *>(sqes_) + index;
+    *sqe = {};
+    return sqe;
+}
+
+bool IoUring::PrepareSendmsg(int fd, const msghdr *msg, std::uint64_t user_data)
+{
+    auto *sqe = static_cast<io_uring_sqe *>(GetSqe());
+    if (!sqe)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(msg);
+    sqe->len = 1;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::PrepareRecvmsg(int fd, msghdr *msg, int flags, std::uint64_t user_data)
+{
+    auto *sqe = static_cast<io_uring_sqe *>(GetSqe());
+    if (!sqe)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = static_cast<std::uint32_t>(flags);
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::PrepareWrite(int fd, const void *buf, std::size_t len, std::uint64_t offset, std::uint64_t user_data)
+{
+    auto *sqe = static_cast<io_uring_sqe *>(GetSqe());
+    if (!sqe)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+    sqe->len = static_cast<std::uint32_t>(len);
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::PrepareRead(int fd, void *buf, std::size_t len, std::uint64_t offset, std::uint64_t user_data)
+{
+    auto *sqe = static_cast<io_uring_sqe *>(GetSqe());
+    if (!sqe)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+    sqe->len = static_cast<std::uint32_t>(len);
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::Submit(unsigned wait_nr)
+{
+    // Publish the prepared entries to the kernel
+    auto to_submit = sqe_tail_ - *sq_tail_;
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+    while (to_submit > 0 || wait_nr > 0)
+    {
+        auto ret = syscall(__NR_io_uring_enter, fd_, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0U,
+                           nullptr, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        to_submit -= static_cast<unsigned>(ret);
+        if (to_submit == 0)
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool IoUring::PopCompletion(std::uint64_t &user_data, std::int32_t &res)
+{
+    auto head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    const auto &cqe = static_cast<const io_uring_cqe *>(cqes_)[head & *cq_mask_];
+    user_data = cqe.user_data;
+    res = cqe.res;
+
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else // TRFTP_HAVE_IO_URING
+
+IoUring::IoUring(unsigned /*entries*/)
+    : fd_{ -1 }
+    , entries_{ 0 }
+    , sq_ring_{ MAP_FAILED }
+    , cq_ring_{ MAP_FAILED }
+    , sqes_{ MAP_FAILED }
+    , sq_ring_size_{ 0 }
+    , cq_ring_size_{ 0 }
+    , sq_head_{ nullptr }
+    , sq_tail_{ nullptr }
+    , sq_mask_{ nullptr }
+    , sq_array_{ nullptr }
+    , sqe_tail_{ 0 }
+    , cq_head_{ nullptr }
+    , cq_tail_{ nullptr }
+    , cq_mask_{ nullptr }
+    , cqes_{ nullptr }
+{
+    throw std::runtime_error("[IoUring] built without io_uring support (TRFTP_WITH_IO_URING=OFF)");
+}
+
+IoUring::~IoUring() = default;
+
+void IoUring::Release()
+{
+}
+
+bool IoUring::IsSupported()
+{
+    return false;
+}
+
+unsigned IoUring::Capacity() const
+{
+    return 0;
+}
+
+void *IoUring::GetSqe()
+{
+    return nullptr;
+}
+
+bool IoUring::PrepareSendmsg(int /*fd*/, const msghdr * /*msg*/, std::uint64_t /*user_data*/)
+{
+    return false;
+}
+
+bool IoUring::PrepareRecvmsg(int /*fd*/, msghdr * /*msg*/, int /*flags*/, std::uint64_t /*user_data*/)
+{
+    return false;
+}
+
+bool IoUring::PrepareWrite(int /*fd*/, const void * /*buf*/, std::size_t /*len*/, std::uint64_t /*offset*/,
+                           std::uint64_t /*user_data*/)
+{
+    return false;
+}
+
+bool IoUring::PrepareRead(int /*fd*/, void * /*buf*/, std::size_t /*len*/, std::uint64_t /*offset*/,
+                          std::uint64_t /*user_data*/)
+{
+    return false;
+}
+
+bool IoUring::Submit(unsigned /*wait_nr*/)
+{
+    return false;
+}
+
+bool IoUring::PopCompletion(std::uint64_t & /*user_data*/, std::int32_t & /*res*/)
+{
+    return false;
+}
+
+#endif // TRFTP_HAVE_IO_URING
+
+} // namespace trftp
\ No newline at end of file
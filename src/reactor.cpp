@@ -0,0 +1,153 @@
+#include "trftp/reactor.h"
+
+namespace trftp
+{
+
+Reactor::Reactor()
+    : epoll_fd_{ -1 }
+    , event_fd_{ -1 }
+    , is_running_{ true }
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0)
+    {
+        throw std::runtime_error("[Reactor] epoll_create1() failed. err=" + std::to_string(errno));
+    }
+
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0)
+    {
+        auto err = errno;
+        close(epoll_fd_);
+        throw std::runtime_error("[Reactor] eventfd() failed. err=" + std::to_string(err));
+    }
+
+    epoll_event event = { .events = EPOLLIN, .data = { .fd = event_fd_ } };
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) < 0)
+    {
+        auto err = errno;
+        close(event_fd_);
+        close(epoll_fd_);
+        throw std::runtime_error("[Reactor] epoll_ctl(eventfd) failed. err=" + std::to_string(err));
+    }
+}
+
+Reactor::~Reactor()
+{
+    for (const auto &[fd, handler] : handlers_)
+    {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    close(event_fd_);
+    close(epoll_fd_);
+}
+
+void Reactor::Add(int fd, Handler handler)
+{
+    std::scoped_lock lock(mutex_);
+
+    epoll_event event = { .events = EPOLLIN, .data = { .fd = fd } };
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        throw std::runtime_error("[Reactor] epoll_ctl(ADD) failed. err=" + std::to_string(errno));
+    }
+
+    handlers_[fd] = std::make_shared<Handler>(std::move(handler));
+}
+
+void Reactor::Remove(int fd)
+{
+    std::scoped_lock lock(mutex_);
+
+    if (handlers_.erase(fd) > 0)
+    {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+int Reactor::AddTimer(Handler handler)
+{
+    auto timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+    {
+        throw std::runtime_error("[Reactor] timerfd_create() failed. err=" + std::to_string(errno));
+    }
+
+    // Consume the expiration before handing it over, so a level-triggered timer fires only once
+    Add(timer_fd, [timer_fd, handler = std::move(handler)]() {
+        std::uint64_t expirations = 0;
+        if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+        {
+            handler();
+        }
+    });
+
+    return timer_fd;
+}
+
+void Reactor::ArmTimer(int timer_fd, std::chrono::microseconds timeout) const
+{
+    const itimerspec spec = {
+        .it_interval = { .tv_sec = 0, .tv_nsec = 0 },
+        .it_value = { .tv_sec = (timeout.count() / 1'000'000), .tv_nsec = (timeout.count() % 1'000'000) * 1'000 },
+    };
+
+    if (timerfd_settime(timer_fd, 0, &spec, nullptr) < 0)
+    {
+        throw std::runtime_error("[Reactor] timerfd_settime() failed. err=" + std::to_string(errno));
+    }
+}
+
+void Reactor::RemoveTimer(int timer_fd)
+{
+    Remove(timer_fd);
+    close(timer_fd);
+}
+
+void Reactor::Run()
+{
+    std::array<epoll_event, 16> events;
+    while (is_running_)
+    {
+        // Sleep until a descriptor is readable, a timer expires or Stop() is called
+        auto count = epoll_wait(epoll_fd_, events.data(), events.size(), -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            throw std::runtime_error("[Reactor] epoll_wait() failed. err=" + std::to_string(errno));
+        }
+
+        for (auto i = 0; (i < count) && is_running_; i++)
+        {
+            std::shared_ptr<Handler> handler;
+            {
+                std::scoped_lock lock(mutex_);
+                if (auto it = handlers_.find(events[i].data.fd); it != handlers_.end())
+                {
+                    handler = it->second;
+                }
+            }
+
+            // Run without the lock, so handlers may add or remove descriptors
+            if (handler)
+            {
+                (*handler)();
+            }
+        }
+    }
+}
+
+void Reactor::Stop()
+{
+    is_running_ = false;
+
+    std::uint64_t one = 1;
+    std::ignore = write(event_fd_, &one, sizeof(one));
+}
+
+} // namespace trftp
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "trftp/rtt_estimator.h"
+
+namespace trftp
+{
+
+RttEstimator::RttEstimator()
+    : mutex_{}
+    , has_sample_{ false }
+    , srtt_{ 0 }
+    , rttvar_{ 0 }
+{
+}
+
+void RttEstimator::AddSample(Duration sent, Duration received)
+{
+    if ((sent == Duration::zero()) || (received <= sent))
+    {
+        return;
+    }
+
+    const auto rtt = received - sent;
+
+    std::scoped_lock lock(mutex_);
+    if (!has_sample_)
+    {
+        srtt_ = rtt;
+        rttvar_ = rtt / 2;
+        has_sample_ = true;
+        return;
+    }
+
+    // alpha = 1/8, beta = 1/4
+    const auto error = (srtt_ > rtt) ? (srtt_ - rtt) : (rtt - srtt_);
+    rttvar_ = rttvar_ - rttvar_ / 4 + error / 4;
+    srtt_ = srtt_ - srtt_ / 8 + rtt / 8;
+}
+
+std::optional<RttEstimator::Duration> RttEstimator::SmoothedRtt() const
+{
+    std::scoped_lock lock(mutex_);
+    return has_sample_ ? std::optional{ srtt_ } : std::nullopt;
+}
+
+RttEstimator::Duration RttEstimator::Timeout(Duration min, Duration max) const
+{
+    std::scoped_lock lock(mutex_);
+    if (!has_sample_)
+    {
+        return min;
+    }
+
+    return std::clamp(srtt_ + 4 * rttvar_, min, max);
+}
+
+void RttEstimator::Reset()
+{
+    std::scoped_lock lock(mutex_);
+    has_sample_ = false;
+    srtt_ = Duration::zero();
+    rttvar_ = Duration::zero();
+}
+
+} // namespace trftp
\ No newline at end of file
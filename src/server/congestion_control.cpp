@@ -0,0 +1,239 @@
+#include "trftp/server/congestion_control.h"
+
+namespace trftp
+{
+
+static constexpr double AIMD_DECREASE = 0.5;                     // Rate kept after a loss
+static constexpr double STARTUP_GAIN = 2.89;                     // 2 / ln(2), doubles the delivery rate every round
+static constexpr double FULL_BANDWIDTH_GROWTH = 1.25;            // Startup goes on while a round grows this much
+static constexpr std::uint32_t FULL_BANDWIDTH_ROUNDS = 3;        // Rounds without that growth that end startup
+static constexpr std::size_t BANDWIDTH_SAMPLES = 10;             // Acknowledgements the bandwidth filter spans
+static constexpr auto MIN_RTT_WINDOW = std::chrono::seconds(10); // Age after which the minimum RTT is renewed
+static constexpr double PROBE_GAINS[] = { 1.25, 0.75, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0 };
+
+static double ToSeconds(std::chrono::nanoseconds duration)
+{
+    return std::chrono::duration<double>(duration).count();
+}
+
+std::unique_ptr<CongestionControl> CongestionControl::Create(CongestionAlgorithm algorithm,
+                                                             std::chrono::nanoseconds initial_gap)
+{
+    switch (algorithm)
+    {
+    case CongestionAlgorithm::AIMD:
+        return std::make_unique<AimdControl>(initial_gap);
+    case CongestionAlgorithm::DELAY:
+        return std::make_unique<DelayControl>(initial_gap);
+    default:
+        return std::make_unique<FixedRateControl>(initial_gap, CC_GAP_MAX);
+    }
+}
+
+CongestionControl::CongestionControl(std::chrono::nanoseconds initial_gap)
+    : gap_{ std::clamp(initial_gap, CC_GAP_MIN, CC_GAP_MAX) }
+{
+}
+
+void CongestionControl::OnReceiverDrops(std::uint32_t dropped, Clock::time_point now)
+{
+    OnLoss(dropped, now);
+}
+
+std::chrono::nanoseconds CongestionControl::InterPacketGap() const
+{
+    return gap_;
+}
+
+double CongestionControl::Rate() const
+{
+    return 1.0 / ToSeconds(gap_.load());
+}
+
+void CongestionControl::SetRate(double rate)
+{
+    auto gap = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(1.0 / rate));
+    gap_ = std::clamp(gap, CC_GAP_MIN, CC_GAP_MAX);
+}
+
+FixedRateControl::FixedRateControl(std::chrono::nanoseconds gap, std::chrono::nanoseconds max_gap)
+    : CongestionControl(gap)
+    , max_gap_{ max_gap }
+{
+}
+
+void FixedRateControl::OnAck(std::uint32_t, std::chrono::nanoseconds, Clock::time_point)
+{
+}
+
+void FixedRateControl::OnLoss(std::uint32_t, Clock::time_point)
+{
+}
+
+void FixedRateControl::OnReceiverDrops(std::uint32_t, Clock::time_point)
+{
+    // Drops in the client's socket buffer mean we outran the receiver rather than lost packets on the wire
+    if (InterPacketGap() < max_gap_)
+    {
+        SetRate(std::max(Rate() / 2, 1.0 / ToSeconds(max_gap_)));
+    }
+}
+
+AimdControl::AimdControl(std::chrono::nanoseconds initial_gap)
+    : CongestionControl(initial_gap)
+    , slow_start_{ true }
+    , srtt_{ 0 }
+    , recovery_end_{}
+{
+}
+
+void AimdControl::OnAck(std::uint32_t acked, std::chrono::nanoseconds rtt, Clock::time_point)
+{
+    if (rtt > std::chrono::nanoseconds::zero())
+    {
+        srtt_ = (srtt_ == std::chrono::nanoseconds::zero()) ? rtt : (7 * srtt_ + rtt) / 8;
+    }
+
+    const auto rtt_s = ToSeconds((srtt_ > std::chrono::nanoseconds::zero()) ? srtt_ : CC_RTT_INIT);
+    const auto rate = Rate();
+
+    // Slow start grows the rate by what got acknowledged per RTT (doubling it), congestion avoidance by one
+    // packet per RTT
+    if (slow_start_)
+    {
+        SetRate(rate + acked / rtt_s);
+    }
+    else
+    {
+        SetRate(rate + acked / (rate * rtt_s * rtt_s));
+    }
+}
+
+void AimdControl::OnLoss(std::uint32_t, Clock::time_point now)
+{
+    if (now < recovery_end_)
+    {
+        return;
+    }
+
+    slow_start_ = false;
+    SetRate(Rate() * AIMD_DECREASE);
+    recovery_end_ = now + ((srtt_ > std::chrono::nanoseconds::zero()) ? srtt_ : CC_RTT_INIT);
+}
+
+DelayControl::DelayControl(std::chrono::nanoseconds initial_gap)
+    : CongestionControl(initial_gap)
+    , phase_{ Phase::STARTUP }
+    , cycle_index_{ 0 }
+    , round_start_{}
+    , min_rtt_{ 0 }
+    , min_rtt_time_{}
+    , last_ack_time_{}
+    , bandwidth_samples_{}
+    , bottleneck_bandwidth_{ 0.0 }
+    , full_bandwidth_{ 0.0 }
+    , full_bandwidth_rounds_{ 0 }
+{
+}
+
+void DelayControl::OnAck(std::uint32_t acked, std::chrono::nanoseconds rtt, Clock::time_point now)
+{
+    // 1. Track the propagation delay (minimum RTT) and the bottleneck bandwidth (maximum delivery rate)
+    if ((rtt > std::chrono::nanoseconds::zero()) &&
+        ((min_rtt_ == std::chrono::nanoseconds::zero()) || (rtt < min_rtt_) || (now - min_rtt_time_ > MIN_RTT_WINDOW)))
+    {
+        min_rtt_ = rtt;
+        min_rtt_time_ = now;
+    }
+
+    if ((last_ack_time_ != Clock::time_point{}) && (now > last_ack_time_))
+    {
+        bandwidth_samples_.push_back(acked / ToSeconds(now - last_ack_time_));
+        if (bandwidth_samples_.size() > BANDWIDTH_SAMPLES)
+        {
+            bandwidth_samples_.pop_front();
+        }
+        bottleneck_bandwidth_ = *std::max_element(bandwidth_samples_.begin(), bandwidth_samples_.end());
+    }
+    last_ack_time_ = now;
+
+    if (bottleneck_bandwidth_ <= 0.0)
+    {
+        return;
+    }
+
+    // 2. Advance the phase once per round trip
+    const auto round = (min_rtt_ > std::chrono::nanoseconds::zero()) ? min_rtt_ : CC_RTT_INIT;
+    if (now - round_start_ >= round)
+    {
+        round_start_ = now;
+        switch (phase_)
+        {
+        case Phase::STARTUP:
+            if (bottleneck_bandwidth_ >= full_bandwidth_ * FULL_BANDWIDTH_GROWTH)
+            {
+                full_bandwidth_ = bottleneck_bandwidth_;
+                full_bandwidth_rounds_ = 0;
+            }
+            else if (++full_bandwidth_rounds_ >= FULL_BANDWIDTH_ROUNDS)
+            {
+                phase_ = Phase::DRAIN;
+            }
+            break;
+
+        case Phase::DRAIN:
+            phase_ = Phase::PROBE;
+            cycle_index_ = 0;
+            break;
+
+        case Phase::PROBE:
+            cycle_index_ = (cycle_index_ + 1) % std::size(PROBE_GAINS);
+            break;
+        }
+    }
+
+    // 3. Pace at the bottleneck bandwidth, but stop pushing harder once a queue builds up on the path
+    auto gain = PacingGain();
+    if ((gain > 1.0) && (rtt > min_rtt_ * 5 / 4))
+    {
+        gain = 1.0;
+    }
+
+    // Startup never paces below the rate it started from, the first samples only cover partial rounds
+    const auto rate = gain * bottleneck_bandwidth_;
+    SetRate((phase_ == Phase::STARTUP) ? std::max(rate, Rate()) : rate);
+}
+
+void DelayControl::OnLoss(std::uint32_t, Clock::time_point)
+{
+    // Random loss says little about the path, the RTT and delivery rate already reflect congestion
+}
+
+void DelayControl::OnReceiverDrops(std::uint32_t, Clock::time_point)
+{
+    // The client cannot keep up, so its delivery rate is the bottleneck from now on
+    bandwidth_samples_.clear();
+    bottleneck_bandwidth_ = Rate() / 2;
+    bandwidth_samples_.push_back(bottleneck_bandwidth_);
+    if (phase_ == Phase::STARTUP)
+    {
+        phase_ = Phase::DRAIN;
+    }
+
+    SetRate(bottleneck_bandwidth_);
+}
+
+double DelayControl::PacingGain() const
+{
+    switch (phase_)
+    {
+    case Phase::STARTUP:
+        return STARTUP_GAIN;
+    case Phase::DRAIN:
+        return 1.0 / STARTUP_GAIN;
+    default:
+        return PROBE_GAINS[cycle_index_];
+    }
+}
+
+} // namespace trftp
\ No newline at end of file
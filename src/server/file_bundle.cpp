@@ -0,0 +1,171 @@
+#include "trftp/server/file_bundle.h"
+
+namespace trftp
+{
+
+FileBundle::FileBundle(const std::filesystem::path &dir_path)
+    : sources_{}
+    , manifest_(sizeof(TrftpManifest))
+    , manifest_crc32_{ 0 }
+    , crc32s_{}
+    , segments_{}
+    , size_{ 0 }
+    , mtx_{}
+    , cv_{}
+    , thr_{}
+    , crc32_count_{ 0 }
+    , stopping_{ false }
+    , seams_{}
+{
+    // Paths are sorted, so the same directory always gives the same stream
+    std::vector<std::filesystem::path> paths;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(dir_path))
+    {
+        if (entry.is_regular_file())
+        {
+            paths.push_back(entry.path().lexically_relative(dir_path));
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    if (paths.empty())
+    {
+        throw std::runtime_error("[FileBundle] " + dir_path.string() + " holds no files");
+    }
+
+    // Only the manifest is built now, none of the files is read before it is sent
+    for (const auto &path : paths)
+    {
+        const auto &name = path.generic_string();
+        if (name.size() > TRFTP_MANIFEST_MAX_PATH)
+        {
+            throw std::runtime_error("[FileBundle] Path of " + path.string() + " is too long");
+        }
+
+        sources_.push_back(FileSource::Open(dir_path / path));
+        TrftpManifestEntry entry{ sources_.back()->Size(), static_cast<std::uint32_t>(name.size()) };
+        const auto *entry_bytes = reinterpret_cast<const std::uint8_t *>(&entry);
+        manifest_.insert(manifest_.end(), entry_bytes, entry_bytes + sizeof(entry));
+        manifest_.insert(manifest_.end(), name.begin(), name.end());
+    }
+    TrftpManifest header{ static_cast<std::uint32_t>(manifest_.size()), static_cast<std::uint32_t>(paths.size()) };
+    std::memcpy(manifest_.data(), &header, sizeof(header));
+    manifest_crc32_ = CalculateCrc32(manifest_.data(), manifest_.size());
+
+    // The stream is sent from where its parts live, each CRC32 only once its file has been checksummed
+    crc32s_.assign(sources_.size(), 0U);
+    segments_.push_back({ 0, manifest_.data(), manifest_.size(), 0 });
+    size_ = manifest_.size();
+    for (std::size_t i = 0; i < sources_.size(); i++)
+    {
+        if (sources_[i]->Size() > 0)
+        {
+            segments_.push_back({ size_, sources_[i]->Data(), sources_[i]->Size(), 0 });
+            size_ += sources_[i]->Size();
+        }
+        segments_.push_back({ size_, reinterpret_cast<const std::uint8_t *>(&crc32s_[i]), sizeof(crc32s_[i]), i + 1 });
+        size_ += sizeof(crc32s_[i]);
+    }
+
+    thr_ = std::thread(&FileBundle::Checksum, this);
+}
+
+FileBundle::~FileBundle()
+{
+    {
+        std::scoped_lock lock(mtx_);
+        stopping_ = true;
+    }
+
+    if (thr_.joinable())
+    {
+        thr_.join();
+    }
+}
+
+std::size_t FileBundle::Size() const
+{
+    return size_;
+}
+
+std::uint32_t FileBundle::FileCount() const
+{
+    return static_cast<std::uint32_t>(sources_.size());
+}
+
+std::uint32_t FileBundle::ManifestCrc32() const
+{
+    return manifest_crc32_;
+}
+
+const std::uint8_t *FileBundle::Payload(std::uint64_t offset, std::size_t len)
+{
+    // Most payloads lie within one file and are sent from its mapping as they are
+    auto segment = std::prev(std::upper_bound(segments_.begin(), segments_.end(), offset,
+                                              [](std::uint64_t pos, const Segment &s) { return pos < s.offset; }));
+    if ((segment->crc32_count == 0) && (offset + len <= segment->offset + segment->length))
+    {
+        return segment->data + (offset - segment->offset);
+    }
+
+    // The others are copied together once, after the CRC32s they carry have been calculated. They stay in place for
+    // retransmits and zero-copy sends until the bundle is released.
+    std::unique_lock lock(mtx_);
+    auto &seam = seams_[{ offset, len }];
+    if (seam.empty())
+    {
+        std::size_t crc32_count = 0;
+        for (auto it = segment; (it != segments_.end()) && (it->offset < offset + len); ++it)
+        {
+            crc32_count = std::max(crc32_count, it->crc32_count);
+        }
+        cv_.wait(lock, [this, crc32_count]() { return crc32_count_ >= crc32_count; });
+
+        seam.resize(len);
+        for (std::size_t copied = 0; copied < len; ++segment)
+        {
+            const auto from = offset + copied - segment->offset;
+            const auto n = std::min<std::uint64_t>(segment->length - from, len - copied);
+            std::memcpy(seam.data() + copied, segment->data + from, n);
+            copied += n;
+        }
+    }
+
+    return seam.data();
+}
+
+void FileBundle::Checksum()
+{
+    for (std::size_t i = 0; i < sources_.size(); i++)
+    {
+        if (i + 1 < sources_.size())
+        {
+            sources_[i + 1]->WillNeed();
+        }
+
+        // Checksum in chunks, so the bundle can be released while a large file is still being read
+        const auto &source = sources_[i];
+        std::uint32_t crc32 = 0U;
+        for (std::size_t done = 0; done < source->Size();)
+        {
+            const auto len = std::min<std::size_t>(BUNDLE_CRC32_CHUNK_SIZE, source->Size() - done);
+            crc32 = CalculateCrc32(source->Data() + done, len, crc32);
+            done += len;
+
+            std::scoped_lock lock(mtx_);
+            if (stopping_)
+            {
+                return;
+            }
+        }
+
+        {
+            std::scoped_lock lock(mtx_);
+            crc32s_[i] = crc32;
+            crc32_count_ = i + 1;
+        }
+        cv_.notify_all();
+    }
+}
+
+} // namespace trftp
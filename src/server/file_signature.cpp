@@ -0,0 +1,207 @@
+#include "trftp/server/file_signature.h"
+#include "trftp/util.h"
+
+namespace trftp
+{
+
+static constexpr std::size_t SIGNATURE_CACHE_SIZE = 16; // Versions kept, the oldest ones are dropped first
+static constexpr std::uint32_t NO_BLOCK = -1U;
+
+static std::mutex signatures_mutex;
+static std::map<std::uint32_t, std::shared_ptr<const FileSignature>> signatures; // By file version
+
+// rsync's weak checksum of a block: a is the sum of its bytes, b the sum of a over the block
+static void StartChecksum(const std::uint8_t *data, std::size_t len, std::uint32_t &a, std::uint32_t &b)
+{
+    a = 0;
+    b = 0;
+    for (std::size_t i = 0; i < len; i++)
+    {
+        a += data[i];
+        b += a;
+    }
+}
+
+// Slides the block one byte further, dropping out and taking in
+static void RollChecksum(std::uint32_t &a, std::uint32_t &b, std::uint8_t out, std::uint8_t in, std::size_t len)
+{
+    a += in - out;
+    b += a - static_cast<std::uint32_t>(len * out);
+}
+
+static std::uint32_t WeakChecksum(std::uint32_t a, std::uint32_t b)
+{
+    return (a & 0xFFFFU) | (b << 16);
+}
+
+FileSignature::FileSignature(const std::uint8_t *data, std::size_t size)
+    : size_{ size }
+    , crc32_{ CalculateCrc32(data, size) }
+    , block_size_{ std::clamp(static_cast<std::uint32_t>(std::sqrt(double(size))) & ~63U, SIGNATURE_BLOCK_MIN,
+                              SIGNATURE_BLOCK_MAX) }
+    , strong_{}
+    , blocks_{}
+    , delta_mutex_{}
+    , delta_{ nullptr }
+    , delta_size_{ 0 }
+    , delta_crc32_{ 0 }
+{
+    // A shorter last block is left out, it can only match at the very end of a file anyway
+    const auto block_count = size_ / block_size_;
+    strong_.reserve(block_count);
+    for (std::size_t i = 0; i < block_count; i++)
+    {
+        const auto *block = data + i * block_size_;
+        const auto strong = CalculateCrc32(block, block_size_);
+        strong_.push_back(strong);
+
+        // Repeated blocks (e.g. zero padding) are listed once, any of them may be copied
+        std::uint32_t a, b;
+        StartChecksum(block, block_size_, a, b);
+        auto &candidates = blocks_[WeakChecksum(a, b)];
+        if (std::none_of(candidates.begin(), candidates.end(), [&](std::uint32_t k) { return strong_[k] == strong; }))
+        {
+            candidates.push_back(i);
+        }
+    }
+}
+
+std::shared_ptr<const FileSignature> FileSignature::Store(std::uint32_t file_version, const std::uint8_t *data,
+                                                          std::size_t size)
+{
+    auto signature = std::shared_ptr<const FileSignature>(new FileSignature(data, size));
+
+    std::scoped_lock lock(signatures_mutex);
+    signatures[file_version] = signature;
+    while (signatures.size() > SIGNATURE_CACHE_SIZE)
+    {
+        signatures.erase(signatures.begin());
+    }
+
+    return signature;
+}
+
+std::shared_ptr<const FileSignature> FileSignature::Find(std::uint32_t file_version)
+{
+    std::scoped_lock lock(signatures_mutex);
+
+    auto it = signatures.find(file_version);
+    return (it != signatures.end()) ? it->second : nullptr;
+}
+
+std::shared_ptr<const FileSignature::Delta> FileSignature::Encode(const std::uint8_t *data, std::size_t size,
+                                                                  std::uint32_t crc32) const
+{
+    std::scoped_lock lock(delta_mutex_);
+    if (delta_ && (delta_size_ == size) && (delta_crc32_ == crc32))
+    {
+        return delta_;
+    }
+
+    auto delta = std::make_shared<Delta>();
+    auto append = [&delta](const TrftpDeltaOp &op, const std::uint8_t *literal) {
+        const auto *bytes = reinterpret_cast<const std::uint8_t *>(&op);
+        delta->insert(delta->end(), bytes, bytes + sizeof(op));
+        if (op.offset == TRFTP_DELTA_LITERAL)
+        {
+            delta->insert(delta->end(), literal, literal + op.length);
+        }
+    };
+
+    // Slide a block over the file a byte at a time. Where it matches a block of the signature, the bytes passed
+    // since the last match become a literal and the block a copy, merged with the previous copy if it continues it.
+    TrftpDeltaOp copy{ TRFTP_DELTA_LITERAL, 0 };
+    std::size_t literal_offset = 0;
+    std::size_t pos = 0;
+    std::uint32_t a = 0, b = 0;
+    bool rolling = false;
+    while (pos + block_size_ <= size)
+    {
+        if (!rolling)
+        {
+            StartChecksum(data + pos, block_size_, a, b);
+            rolling = true;
+        }
+
+        if (auto block = FindBlock(WeakChecksum(a, b), data + pos); block != NO_BLOCK)
+        {
+            const auto offset = block * block_size_;
+            if ((pos > literal_offset) || (copy.length > 0 && copy.offset + copy.length != offset))
+            {
+                if (copy.length > 0)
+                {
+                    append(copy, nullptr);
+                }
+                if (pos > literal_offset)
+                {
+                    append({ TRFTP_DELTA_LITERAL, static_cast<std::uint32_t>(pos - literal_offset) },
+                           data + literal_offset);
+                }
+                copy = { offset, 0 };
+            }
+            else if (copy.length == 0)
+            {
+                copy.offset = offset;
+            }
+
+            copy.length += block_size_;
+            pos += block_size_;
+            literal_offset = pos;
+            rolling = false;
+            continue;
+        }
+
+        if (pos + block_size_ < size)
+        {
+            RollChecksum(a, b, data[pos], data[pos + block_size_], block_size_);
+        }
+        pos++;
+    }
+
+    if (copy.length > 0)
+    {
+        append(copy, nullptr);
+    }
+    if (size > literal_offset)
+    {
+        append({ TRFTP_DELTA_LITERAL, static_cast<std::uint32_t>(size - literal_offset) }, data + literal_offset);
+    }
+
+    delta_ = std::move(delta);
+    delta_size_ = size;
+    delta_crc32_ = crc32;
+    return delta_;
+}
+
+std::uint32_t FileSignature::FindBlock(std::uint32_t weak, const std::uint8_t *data) const
+{
+    auto it = blocks_.find(weak);
+    if (it == blocks_.end())
+    {
+        return NO_BLOCK;
+    }
+
+    // Weak checksums collide easily, so a match is only taken with the same CRC32
+    const auto strong = CalculateCrc32(data, block_size_);
+    for (auto block : it->second)
+    {
+        if (strong_[block] == strong)
+        {
+            return block;
+        }
+    }
+
+    return NO_BLOCK;
+}
+
+std::size_t FileSignature::Size() const
+{
+    return size_;
+}
+
+std::uint32_t FileSignature::Crc32() const
+{
+    return crc32_;
+}
+
+} // namespace trftp
@@ -0,0 +1,124 @@
+#include "trftp/server/file_source.h"
+
+namespace trftp
+{
+
+FileSource::FileSource(const std::filesystem::path &file_path)
+    : data_{ nullptr }
+    , size_{ 0 }
+    , mtime_{}
+    , crc32_once_{}
+    , crc32_{ 0 }
+    , compressed_once_{}
+    , compressed_{ nullptr }
+{
+    auto fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::runtime_error("[FileSource] open(" + file_path.string() + ") failed. err=" + std::to_string(errno));
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    auto fd_guard = std::unique_ptr<int, void (*)(const int *)>(&fd, [](const int *fd) { close(*fd); });
+
+    struct stat st = {};
+    if (fstat(fd, &st) < 0)
+    {
+        throw std::runtime_error("[FileSource] fstat(" + file_path.string() + ") failed. err=" + std::to_string(errno));
+    }
+
+    size_ = st.st_size;
+    mtime_ = st.st_mtim;
+    if (size_ == 0)
+    {
+        return;
+    }
+
+    auto *addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        throw std::runtime_error("[FileSource] mmap(" + file_path.string() + ") failed. err=" + std::to_string(errno));
+    }
+
+    // DATA packets are read front to back; retransmits only step back a little
+    std::ignore = madvise(addr, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<std::uint8_t *>(addr);
+}
+
+FileSource::~FileSource()
+{
+    if (data_)
+    {
+        munmap(data_, size_);
+    }
+}
+
+std::shared_ptr<FileSource> FileSource::Open(const std::filesystem::path &file_path)
+{
+    static std::unordered_map<std::string, std::weak_ptr<FileSource>> file_sources;
+    static std::mutex map_mutex;
+
+    const auto &key = std::filesystem::canonical(file_path).string();
+
+    // Thread-safe access to the map
+    std::scoped_lock lock(map_mutex);
+
+    auto &weak_source = file_sources[key];
+    if (auto source = weak_source.lock())
+    {
+        // Reuse the mapping only if the file has not been replaced or modified since
+        struct stat st = {};
+        if ((stat(key.c_str(), &st) == 0) && (static_cast<std::size_t>(st.st_size) == source->size_) &&
+            (st.st_mtim.tv_sec == source->mtime_.tv_sec) && (st.st_mtim.tv_nsec == source->mtime_.tv_nsec))
+        {
+            return source;
+        }
+    }
+
+    auto source = std::shared_ptr<FileSource>(new FileSource(key));
+    weak_source = source;
+
+    // Drop entries of files no transaction is sending anymore
+    for (auto it = file_sources.begin(); it != file_sources.end();)
+    {
+        it = it->second.expired() ? file_sources.erase(it) : std::next(it);
+    }
+
+    return source;
+}
+
+const std::uint8_t *FileSource::Data() const
+{
+    return data_;
+}
+
+std::size_t FileSource::Size() const
+{
+    return size_;
+}
+
+std::uint32_t FileSource::Crc32() const
+{
+    std::call_once(crc32_once_, [this]() { crc32_ = CalculateCrc32(data_, size_); });
+
+    return crc32_;
+}
+
+std::shared_ptr<const std::vector<std::uint8_t>> FileSource::Compressed() const
+{
+    std::call_once(compressed_once_, [this]() {
+        compressed_ = std::make_shared<const std::vector<std::uint8_t>>(CompressStream(data_, size_));
+    });
+
+    return compressed_;
+}
+
+void FileSource::WillNeed() const
+{
+    if (data_)
+    {
+        std::ignore = madvise(data_, size_, MADV_WILLNEED);
+    }
+}
+
+} // namespace trftp
\ No newline at end of file
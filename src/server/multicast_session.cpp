@@ -0,0 +1,330 @@
+#include "trftp/server/multicast_session.h"
+#include "trftp/server/server_log.h"
+
+namespace trftp
+{
+
+MulticastSession::MulticastSession(std::shared_ptr<ServerTransaction> group, UdpSocket &udp_socket)
+    : group_{ std::move(group) }
+    , udp_socket_{ udp_socket }
+    , mtx_{}
+    , cv_{}
+    , joining_{ true }
+    , receivers_{}
+{
+    // Every receiver takes DATA as it is sent to the group, so nothing is negotiated per receiver
+    group_->features_ = TRFTP_FEATURE_SACK | TRFTP_FEATURE_MULTICAST |
+                        (group_->features_ & (TRFTP_FEATURE_BUNDLE | TRFTP_FEATURE_LARGE_FILE));
+}
+
+std::vector<std::string> MulticastSession::Run()
+{
+    // 1. Announce the file to the group. Every client answering within the join window is sent INFO.
+    std::unique_lock lock(mtx_);
+    const auto join_end = std::chrono::steady_clock::now() + TRAN_MULTICAST_JOIN_WINDOW;
+    while (std::chrono::steady_clock::now() < join_end)
+    {
+        group_->SendMessage(MessageId::NTF, udp_socket_);
+        cv_.wait_until(lock, std::min(join_end, std::chrono::steady_clock::now() + TRAN_MULTICAST_ANNOUNCE_INTERVAL));
+    }
+    joining_ = false;
+
+    // 2. Wait for the RDY of every receiver, then send DATA to those that got that far
+    cv_.wait_for(lock, group_->ResponseTimeout(), [this]() {
+        return std::none_of(receivers_.begin(), receivers_.end(),
+                            [](const auto &entry) { return entry.second.status == FtpStatus::CHK; });
+    });
+    for (auto &[key, receiver] : receivers_)
+    {
+        if (receiver.status == FtpStatus::CHK)
+        {
+            DropReceiver(receiver, "did not answer INFO");
+        }
+    }
+    if (std::none_of(receivers_.begin(), receivers_.end(),
+                     [this](const auto &entry) { return IsActive(entry.second); }))
+    {
+        terr << ServerLog() << "No client joined the multicast transfer" << std::endl;
+        return {};
+    }
+
+    StartData();
+
+    // 3. Repair until every receiver has the file or has dropped out
+    const auto data_end = std::chrono::steady_clock::now() + TRAN_MULTICAST_DATA_TIMEOUT;
+    while (std::any_of(receivers_.begin(), receivers_.end(),
+                       [this](const auto &entry) { return IsActive(entry.second); }))
+    {
+        cv_.wait_for(lock, TRAN_MULTICAST_ANNOUNCE_INTERVAL);
+
+        const auto now = std::chrono::steady_clock::now();
+        for (auto &[key, receiver] : receivers_)
+        {
+            if (IsActive(receiver) && (now >= data_end))
+            {
+                DropReceiver(receiver, "timed out");
+            }
+            else if (IsActive(receiver) && (now - receiver.last_seen >= TRAN_MULTICAST_SILENCE))
+            {
+                DropReceiver(receiver, "fell silent");
+            }
+        }
+        UpdateGroupProgress();
+    }
+
+    std::vector<std::string> received;
+    for (const auto &[key, receiver] : receivers_)
+    {
+        if (receiver.status == FtpStatus::FIN)
+        {
+            received.push_back(key);
+        }
+    }
+    tout << ServerLog() << received.size() << " of " << receivers_.size() << " receivers got the file" << std::endl;
+    lock.unlock();
+
+    // Stop the DATA thread. Receivers still listening to the group learn that nobody got the file.
+    if (received.empty())
+    {
+        group_->SendMessage(MessageId::CXL, udp_socket_);
+    }
+    else
+    {
+        {
+            std::scoped_lock group_lock(group_->mtx_);
+            group_->status_ = FtpStatus::FIN;
+        }
+        group_->cv_.notify_all();
+    }
+
+    return received;
+}
+
+bool MulticastSession::IsReceiver(const sockaddr_in &addr)
+{
+    std::scoped_lock lock(mtx_);
+    return receivers_.count(AddressKey(addr)) > 0;
+}
+
+void MulticastSession::OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr)
+{
+    std::scoped_lock lock(mtx_);
+    group_->PrintRecvLog(msg, addr);
+
+    if (!group_->ValidateMessageIntegrity(msg, len))
+    {
+        terr << ServerLog() << "Message integrity check failed. Discarding..." << std::endl;
+        return;
+    }
+
+    const auto &id = MessageId(msg.header.xid);
+    const auto &payload_len = len - sizeof(TrftpHeader);
+    const auto &key = AddressKey(addr);
+
+    // Clients join by answering the announcement
+    if (id == MessageId::CHK)
+    {
+        if (!joining_)
+        {
+            terr << ServerLog() << "Join window of the multicast transfer is closed. Cancelling..." << std::endl;
+            group_->SendMessageTo(MessageId::CXL, udp_socket_, addr);
+            return;
+        }
+        if ((receivers_.count(key) > 0) || !group_->ValidateMessage(msg.chk, payload_len))
+        {
+            return;
+        }
+
+        receivers_.emplace(key, Receiver{ addr, id, 0, 0, 0, 0, std::chrono::steady_clock::now() });
+        group_->SendMessageTo(MessageId::INFO, udp_socket_, addr);
+        return;
+    }
+
+    auto it = receivers_.find(key);
+    if ((it == receivers_.end()) || (it->second.status == FtpStatus::FIN) || (it->second.status == FtpStatus::CXL))
+    {
+        terr << ServerLog() << "<" << key << "> is not receiving the multicast transfer. Discarding..." << std::endl;
+        return;
+    }
+
+    auto &receiver = it->second;
+    receiver.last_seen = std::chrono::steady_clock::now();
+
+    switch (id)
+    {
+    case MessageId::RDY:
+        if (receiver.status != FtpStatus::CHK)
+        {
+            terr << ServerLog() << "Receiver state is not <CHK>. Discarding..." << std::endl;
+            return;
+        }
+        if (!group_->ValidateMessage(msg.rdy, payload_len))
+        {
+            return;
+        }
+
+        // DATA to the group has one payload size and is acknowledged with SACK by everyone
+        if ((payload_len < offsetof(TrftpRdy, fec_block_size)) || (msg.rdy.payload_size != group_->payload_size_) ||
+            (msg.rdy.receive_window == 0) ||
+            ((payload_len >= offsetof(TrftpRdy, resume_psn)) && (msg.rdy.fec_block_size != 0)) ||
+            ((payload_len >= offsetof(TrftpRdy, delta_length)) && (msg.rdy.resume_psn != 0)))
+        {
+            DropReceiver(receiver, "cannot take DATA as it is sent to the group");
+            break;
+        }
+
+        receiver.status = id;
+        receiver.receive_window = msg.rdy.receive_window;
+        receiver.inter_packet_gap = msg.rdy.inter_packet_gap;
+        break;
+
+    case MessageId::SACK:
+        if ((receiver.status != FtpStatus::RDY) && (receiver.status != FtpStatus::DATA))
+        {
+            terr << ServerLog() << "Receiver state is not <RDY> or <DATA>. Discarding..." << std::endl;
+            return;
+        }
+        if (!group_->ValidateMessage(msg.sack, payload_len))
+        {
+            return;
+        }
+
+        receiver.status = FtpStatus::DATA;
+        receiver.acked_psn = std::max(receiver.acked_psn, msg.sack.base_psn);
+        receiver.receive_drops = std::max(receiver.receive_drops, msg.sack.receive_drops);
+        if (msg.sack.receive_window > 0)
+        {
+            receiver.receive_window = msg.sack.receive_window;
+        }
+
+        // A hole is repaired once for the whole group, whoever reports it
+        {
+            std::scoped_lock group_lock(group_->mtx_);
+            if (auto lost = group_->QueueRetransmits(msg.sack); lost > 0)
+            {
+                group_->congestion_control_->OnLoss(lost, CongestionControl::Clock::now());
+            }
+        }
+        UpdateGroupProgress();
+        return;
+
+    case MessageId::DONE:
+        if ((receiver.status != FtpStatus::RDY) && (receiver.status != FtpStatus::DATA))
+        {
+            terr << ServerLog() << "Receiver state is not <RDY> or <DATA>. Discarding..." << std::endl;
+            return;
+        }
+        if (!group_->ValidateMessage(msg.done, payload_len, group_->ExpectedDone()))
+        {
+            return;
+        }
+
+        receiver.status = FtpStatus::FIN;
+        group_->SendMessageTo(MessageId::FIN, udp_socket_, addr);
+        UpdateGroupProgress();
+        break;
+
+    case MessageId::CXL:
+        if (!group_->ValidateMessage(msg.cxl, payload_len))
+        {
+            return;
+        }
+
+        terr << ServerLog() << "<" << key << "> cancelled the multicast transfer" << std::endl;
+        receiver.status = id;
+        UpdateGroupProgress();
+        break;
+
+    default:
+        terr << ServerLog() << "Unexpected XID (" << msg.header.xid << ") in a multicast transfer. Discarding..."
+             << std::endl;
+        return;
+    }
+
+    cv_.notify_all();
+}
+
+std::string MulticastSession::AddressKey(const sockaddr_in &addr)
+{
+    return std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(be16toh(addr.sin_port));
+}
+
+bool MulticastSession::IsActive(const Receiver &receiver) const
+{
+    return (receiver.status == FtpStatus::RDY) || (receiver.status == FtpStatus::DATA);
+}
+
+void MulticastSession::StartData()
+{
+    // The slowest receiver sets the pace and the smallest receive window bounds DATA in flight
+    std::uint32_t receive_window = -1U;
+    std::uint32_t inter_packet_gap = 0;
+    std::size_t receiver_count = 0;
+    for (const auto &[key, receiver] : receivers_)
+    {
+        if (IsActive(receiver))
+        {
+            receive_window = std::min(receive_window, receiver.receive_window);
+            inter_packet_gap = std::max(inter_packet_gap, receiver.inter_packet_gap);
+            receiver_count++;
+        }
+    }
+
+    {
+        std::scoped_lock group_lock(group_->mtx_);
+        group_->total_packet_number_ =
+            static_cast<std::uint32_t>((group_->data_length_ + group_->payload_size_ - 1) / group_->payload_size_);
+        group_->receive_window_ = receive_window;
+        group_->acked_psn_ = 0;
+        group_->congestion_control_ = group_->CreateCongestionControl(
+            group_->congestion_algorithm_,
+            std::chrono::microseconds(std::clamp(inter_packet_gap, TRAN_IPG_MIN, TRAN_IPG_MAX)));
+        std::fill(group_->send_times_.begin(), group_->send_times_.end(), CongestionControl::Clock::time_point{});
+    }
+
+    tout << ServerLog() << "Sending to " << receiver_count << " receivers of the group" << std::endl;
+    group_->SendMessage(MessageId::DATA, udp_socket_);
+}
+
+void MulticastSession::DropReceiver(Receiver &receiver, const char *reason)
+{
+    terr << ServerLog() << "Dropping <" << AddressKey(receiver.address) << "> from the multicast transfer, it "
+         << reason << std::endl;
+    receiver.status = FtpStatus::CXL;
+    group_->SendMessageTo(MessageId::CXL, udp_socket_, receiver.address);
+}
+
+void MulticastSession::UpdateGroupProgress()
+{
+    if (group_->sent_status_ != FtpStatus::DATA)
+    {
+        return;
+    }
+
+    // DATA is acknowledged up to the slowest receiver still taking part
+    std::uint32_t acked_psn = group_->total_packet_number_;
+    std::uint32_t receive_window = -1U;
+    std::uint32_t receive_drops = 0;
+    for (const auto &[key, receiver] : receivers_)
+    {
+        receive_drops += receiver.receive_drops;
+        if (IsActive(receiver))
+        {
+            acked_psn = std::min(acked_psn, receiver.acked_psn);
+            receive_window = std::min(receive_window, receiver.receive_window);
+        }
+    }
+
+    {
+        std::scoped_lock group_lock(group_->mtx_);
+        group_->AcknowledgeData(acked_psn, CongestionControl::Clock::now());
+        if (receive_window != -1U)
+        {
+            group_->receive_window_ = receive_window;
+        }
+    }
+    group_->UpdateReceiverDrops(receive_drops);
+    group_->cv_.notify_all();
+}
+
+} // namespace trftp
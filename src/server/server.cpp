@@ -7,11 +7,41 @@ namespace trftp
 using namespace std::chrono_literals;
 
 Server::Server(std::uint16_t port, std::shared_ptr<ServerTransactionFactory> factory)
-    : udp_socket_(port)
-    , is_running_(true)
-    , thread_(&Server::HandleIncomingMessages, this)
+    : Server(port, 1, std::move(factory))
+{
+}
+
+Server::Server(std::uint16_t port, std::size_t receive_shards, std::shared_ptr<ServerTransactionFactory> factory)
+    : udp_socket_(port, receive_shards > 1)
+    , reactor_()
+    , shards_()
     , factory_(std::move(factory))
+    , payload_size_(TRFTP_PAYLOAD_SIZE)
+    , path_mtu_probe_(false)
+    , congestion_algorithm_(CongestionAlgorithm::AIMD)
+    , delta_transfer_(false)
+    , compression_(false)
+    , fast_handshake_(false)
 {
+    for (std::size_t i = 1; i < receive_shards; i++)
+    {
+        shards_.push_back(std::make_unique<ReceiveShard>(port));
+    }
+
+    if (!shards_.empty() && !udp_socket_.SetReusePortSteering(receive_shards))
+    {
+        terr << ServerLog() << "SO_ATTACH_REUSEPORT_CBPF failed. Falling back to the kernel flow hash..." << std::endl;
+    }
+
+    reactor_.Add(udp_socket_.Fd(), [this]() { HandleIncomingMessages(udp_socket_); });
+    thread_ = std::thread(&Reactor::Run, &reactor_);
+
+    for (auto &shard : shards_)
+    {
+        shard->reactor.Add(shard->udp_socket.Fd(),
+                           [this, &udp_socket = shard->udp_socket]() { HandleIncomingMessages(udp_socket); });
+        shard->thread = std::thread(&Reactor::Run, &shard->reactor);
+    }
 }
 
 Server::Server(std::shared_ptr<ServerTransactionFactory> factory)
@@ -21,12 +51,23 @@ Server::Server(std::shared_ptr<ServerTransactionFactory> factory)
 
 Server::~Server()
 {
-    is_running_ = false;
+    reactor_.Stop();
+    for (auto &shard : shards_)
+    {
+        shard->reactor.Stop();
+    }
 
     if (thread_.joinable())
     {
         thread_.join();
     }
+    for (auto &shard : shards_)
+    {
+        if (shard->thread.joinable())
+        {
+            shard->thread.join();
+        }
+    }
 }
 
 FtpStatus Server::StartFileTransfer(const std::string &client_uri, const std::filesystem::path &file_path,
@@ -58,97 +99,346 @@ FtpStatus Server::StartFileTransfer(const std::string &client_uri, const std::fi
 
     auto tran = factory_->CreateTransaction(device, client_addr, file_path, file_version);
 
-    if (auto [it, inserted] = active_transactions_.try_emplace(client_ip, tran); !inserted)
+    // Never offer more than the local route carries. Whether the rest of the path does is probed with INFO.
+    const bool probe = path_mtu_probe_;
+    auto payload_size = payload_size_.load();
+    if (auto mtu = probe ? UdpSocket::PathMtu(client_addr) : 0; mtu > TRFTP_PACKET_OVERHEAD)
+    {
+        payload_size = std::min(payload_size, mtu - TRFTP_PACKET_OVERHEAD);
+    }
+    tran->OfferPayloadSize(payload_size, probe);
+    tran->SetCongestionControl(congestion_algorithm_);
+
+    // Compress before the client is involved, so the handshake does not wait for it
+    if (compression_)
+    {
+        tran->PrepareCompression();
+    }
+
+    // Offered before the client's version is known, a fast handshake never carries a delta
+    if (fast_handshake_)
+    {
+        tran->OfferFastHandshake();
+    }
+
+    if (std::scoped_lock lock(transactions_mutex_);
+        !active_transactions_.try_emplace(client_ip, tran).second)
     {
         throw std::runtime_error("Transaction already exists for <" + client_ip + ">");
     }
 
     tran->SendMessage(MessageId::NTF, udp_socket_);
-    auto status = tran->WaitForStatus(1s);
+    auto status = tran->WaitForStatus(tran->ResponseTimeout());
+    if ((!status || (status == FtpStatus::CXL)) && tran->AbandonFastHandshake()) // if only the full one is taken
+    {
+        tran->SendMessage(MessageId::NTF, udp_socket_);
+        status = tran->WaitForStatus(tran->ResponseTimeout());
+    }
+
     if (!status) // if client is not responding (e.g. not exist)
     {
-        active_transactions_.erase(client_ip);
+        RemoveTransaction(client_ip);
         return FtpStatus::NTF;
     }
     else if (status == FtpStatus::CXL)
     {
-        active_transactions_.erase(client_ip);
+        RemoveTransaction(client_ip);
         return FtpStatus::CXL;
     }
-    else if (status != FtpStatus::CHK)
+    else if ((status != FtpStatus::CHK) && (status != FtpStatus::RDY) && (status != FtpStatus::DONE))
     {
         tran->SendMessage(MessageId::CXL, udp_socket_);
-        active_transactions_.erase(client_ip);
+        RemoveTransaction(client_ip);
         return FtpStatus::CXL;
     }
 
-    tran->SendMessage(MessageId::INFO, udp_socket_);
-    status = tran->WaitForStatus(1s);
-    if (status == FtpStatus::CXL)
+    // RDY (or even DONE, when all of a small file went ahead) answers a fast handshake, which takes no INFO
+    if (status == FtpStatus::CHK)
     {
-        active_transactions_.erase(client_ip);
-        return FtpStatus::CXL;
-    }
-    else if (status != FtpStatus::RDY)
-    {
-        tran->SendMessage(MessageId::CXL, udp_socket_);
-        active_transactions_.erase(client_ip);
-        return FtpStatus::CXL;
+        // A client still holding a version sent before only needs what has changed since
+        if (delta_transfer_)
+        {
+            tran->PrepareDelta();
+        }
+
+        tran->SendMessage(MessageId::INFO, udp_socket_);
+        status = tran->WaitForStatus(tran->ResponseTimeout());
+        if (!status && tran->AbandonPathMtuProbe()) // if the padded INFO did not make it through the path
+        {
+            tran->SendMessage(MessageId::INFO, udp_socket_);
+            status = tran->WaitForStatus(tran->ResponseTimeout());
+        }
+
+        if (status == FtpStatus::CXL)
+        {
+            RemoveTransaction(client_ip);
+            return FtpStatus::CXL;
+        }
+        else if (status != FtpStatus::RDY)
+        {
+            tran->SendMessage(MessageId::CXL, udp_socket_);
+            RemoveTransaction(client_ip);
+            return FtpStatus::CXL;
+        }
     }
 
     tran->SendMessage(MessageId::DATA, udp_socket_);
     status = tran->WaitForStatus(5min);
     if (status == FtpStatus::CXL)
     {
-        active_transactions_.erase(client_ip);
+        RemoveTransaction(client_ip);
         return FtpStatus::CXL;
     }
     else if (status != FtpStatus::DONE)
     {
         tran->SendMessage(MessageId::CXL, udp_socket_);
-        active_transactions_.erase(client_ip);
+        RemoveTransaction(client_ip);
         return FtpStatus::CXL;
     }
 
     tran->SendMessage(MessageId::FIN, udp_socket_);
-    active_transactions_.erase(client_ip);
+    RemoveTransaction(client_ip);
+
+    // The client now holds this version, so the next one can be sent to it as a delta
+    if (delta_transfer_ && !std::filesystem::is_directory(file_path) && !FileSignature::Find(file_version))
+    {
+        AddDeltaBase(file_path, file_version);
+    }
+
     return FtpStatus::FIN;
 }
 
+std::vector<std::string> Server::StartMulticastTransfer(const std::string &group_uri,
+                                                        const std::filesystem::path &file_path,
+                                                        std::uint32_t file_version, const Device device)
+{
+    auto pos = group_uri.find(':');
+    if (pos == std::string::npos)
+    {
+        throw std::runtime_error("Invalid group address (" + group_uri + ")");
+    }
+
+    const auto &group_ip = group_uri.substr(0, pos);
+    const auto &group_port = group_uri.substr(pos + 1);
+
+    sockaddr_in group_addr;
+    group_addr.sin_family = AF_INET;
+    group_addr.sin_port = htobe16(std::stoi(group_port));
+    group_addr.sin_addr.s_addr = inet_addr(group_ip.c_str());
+
+    if (!IN_MULTICAST(be32toh(group_addr.sin_addr.s_addr)))
+    {
+        throw std::runtime_error("Invalid multicast group IP (" + group_ip + ")");
+    }
+
+    if (!std::filesystem::exists(file_path))
+    {
+        throw std::runtime_error("File(" + file_path.string() + ") not found");
+    }
+
+    // Every receiver takes the payload size offered, so it is not probed against any one path
+    auto group = factory_->CreateTransaction(device, group_addr, file_path, file_version);
+    group->OfferPayloadSize(payload_size_, false);
+    group->SetCongestionControl(congestion_algorithm_);
+
+    auto session = std::make_shared<MulticastSession>(std::move(group), udp_socket_);
+    if (std::scoped_lock lock(transactions_mutex_); multicast_session_)
+    {
+        throw std::runtime_error("A multicast transfer is already in progress");
+    }
+    else
+    {
+        multicast_session_ = session;
+    }
+
+    auto received = session->Run();
+
+    std::scoped_lock lock(transactions_mutex_);
+    multicast_session_.reset();
+    return received;
+}
+
 void Server::AbortFileTransfer(const std::string &client_ip)
 {
-    auto it = active_transactions_.find(client_ip);
-    if (it == active_transactions_.end())
+    auto tran = FindTransaction(client_ip);
+    if (!tran)
     {
         throw std::runtime_error("No transaction found for <" + client_ip + ">");
     }
 
-    it->second->SendMessage(MessageId::CXL, udp_socket_);
+    tran->SendMessage(MessageId::CXL, udp_socket_);
+}
+
+bool Server::SetSegmentOffload(bool enable)
+{
+    return udp_socket_.SetSegmentOffload(enable);
+}
+
+bool Server::SetIoBackend(IoBackend backend)
+{
+    return udp_socket_.SetIoBackend(backend);
 }
 
-void Server::HandleIncomingMessages()
+bool Server::SetZeroCopy(bool enable)
 {
-    while (is_running_)
+    return udp_socket_.SetZeroCopy(enable);
+}
+
+bool Server::SetPayloadSize(std::uint32_t payload_size)
+{
+    if ((payload_size < TRFTP_MIN_PAYLOAD_SIZE) || (payload_size > TRFTP_MAX_PAYLOAD_SIZE))
     {
-        TrftpMessage msg;
-        sockaddr_in client_addr;
+        return false;
+    }
 
-        auto len = udp_socket_.Receive(msg, client_addr);
-        if (len == 0)
-        {
-            continue;
-        }
+    payload_size_ = payload_size;
+    return true;
+}
 
-        auto it = active_transactions_.find(inet_ntoa(client_addr.sin_addr));
-        if (it == active_transactions_.end())
-        {
-            terr << ServerLog() << "No transaction found for <" << inet_ntoa(client_addr.sin_addr) << ":"
-                 << ntohs(client_addr.sin_port) << ">" << std::endl;
-            continue;
-        }
+bool Server::SetReceiveBuffer(std::size_t bytes)
+{
+    auto ok = udp_socket_.SetReceiveBuffer(bytes);
+    for (auto &shard : shards_)
+    {
+        ok = shard->udp_socket.SetReceiveBuffer(bytes) && ok;
+    }
+
+    return ok;
+}
+
+bool Server::SetSendBuffer(std::size_t bytes)
+{
+    return udp_socket_.SetSendBuffer(bytes);
+}
+
+bool Server::SetTimestamping(Timestamping mode)
+{
+    // Replies may arrive on any receive shard, so all of them have to stamp packets
+    auto ok = udp_socket_.SetTimestamping(mode);
+    for (auto &shard : shards_)
+    {
+        ok = shard->udp_socket.SetTimestamping(mode) && ok;
+    }
+
+    return ok;
+}
+
+void Server::SetCongestionControl(CongestionAlgorithm algorithm)
+{
+    // Applies to transfers started from now on
+    congestion_algorithm_ = algorithm;
+}
+
+void Server::SetDeltaTransfer(bool enable)
+{
+    delta_transfer_ = enable;
+}
+
+void Server::SetCompression(bool enable)
+{
+    compression_ = enable;
+}
+
+void Server::SetFastHandshake(bool enable)
+{
+    fast_handshake_ = enable;
+}
+
+void Server::AddDeltaBase(const std::filesystem::path &file_path, std::uint32_t file_version)
+{
+    // Only the signature is kept, the file itself may be replaced or removed afterwards. Files of 4 GiB and more are
+    // never sent as a delta, so they need none.
+    auto source = FileSource::Open(file_path);
+    if (source->Size() >= TRFTP_LENGTH_LARGE)
+    {
+        return;
+    }
+    FileSignature::Store(file_version, source->Data(), source->Size());
+}
 
-        it->second->OnReceive(msg, len, client_addr);
+bool Server::SetMulticastInterface(const std::string &interface_ip)
+{
+    in_addr interface_addr;
+    if (inet_aton(interface_ip.c_str(), &interface_addr) == 0)
+    {
+        return false;
+    }
+
+    return udp_socket_.SetMulticastInterface(interface_addr);
+}
+
+bool Server::SetMulticastLoop(bool enable)
+{
+    return udp_socket_.SetMulticastLoop(enable);
+}
+
+bool Server::SetPathMtuProbe(bool enable)
+{
+    if (!udp_socket_.SetPathMtuProbe(enable))
+    {
+        return false;
+    }
+
+    path_mtu_probe_ = enable;
+    return true;
+}
+
+void Server::HandleIncomingMessages(UdpSocket &udp_socket)
+{
+    TrftpMessage msg;
+    sockaddr_in client_addr;
+
+    // Zero-copy completions and TX timestamps also wake up the sending socket, so drain them and only read what
+    // is already queued
+    udp_socket.ReapErrorQueue();
+
+    Timestamp rx_time;
+    auto len = udp_socket.Receive(msg, client_addr, false, &rx_time);
+    if (len == 0)
+    {
+        return;
     }
+
+    // Receivers of a multicast transfer are told apart by port, since several may share an IP
+    auto tran = FindTransaction(inet_ntoa(client_addr.sin_addr));
+    if (auto session = FindMulticastSession(); session && (!tran || session->IsReceiver(client_addr)))
+    {
+        session->OnReceive(msg, len, client_addr);
+        return;
+    }
+    if (!tran)
+    {
+        terr << ServerLog() << "No transaction found for <" << inet_ntoa(client_addr.sin_addr) << ":"
+             << ntohs(client_addr.sin_port) << ">" << std::endl;
+        return;
+    }
+
+    tran->OnReceive(msg, len, client_addr, rx_time);
+}
+
+std::shared_ptr<ServerTransaction> Server::FindTransaction(const std::string &client_ip)
+{
+    std::scoped_lock lock(transactions_mutex_);
+
+    auto it = active_transactions_.find(client_ip);
+    return (it != active_transactions_.end()) ? it->second : nullptr;
+}
+
+std::shared_ptr<MulticastSession> Server::FindMulticastSession()
+{
+    std::scoped_lock lock(transactions_mutex_);
+    return multicast_session_;
+}
+
+void Server::RemoveTransaction(const std::string &client_ip)
+{
+    decltype(active_transactions_)::node_type node;
+    {
+        std::scoped_lock lock(transactions_mutex_);
+        node = active_transactions_.extract(client_ip);
+    }
+
+    // The transaction (which may still join its DATA thread) is released outside the lock
 }
 
 } // namespace trftp
\ No newline at end of file
@@ -6,34 +6,91 @@ namespace trftp
 ServerTransaction::ServerTransaction(const sockaddr_in &addr, const std::filesystem::path &file_path,
                                      std::uint32_t file_version, const std::uint32_t device_id)
     : file_path_{ file_path }
+    , file_source_{ std::filesystem::is_directory(file_path) ? nullptr : FileSource::Open(file_path) }
+    , bundle_{ file_source_ ? nullptr : std::make_shared<FileBundle>(file_path) }
     , new_file_version_{ file_version }
-    , new_file_size_{ static_cast<std::uint32_t>(std::filesystem::file_size(file_path)) }
-    , new_file_crc32_{ CalculateFileCrc32(file_path) }
+    , new_file_size_{ bundle_ ? bundle_->Size() : file_source_->Size() }
+    , new_file_crc32_{ bundle_ ? bundle_->ManifestCrc32() : file_source_->Crc32() }
+    , delta_base_{ nullptr }
+    , delta_{ nullptr }
+    , compressed_{ nullptr }
+    , data_{ bundle_ ? nullptr : file_source_->Data() }
+    , data_length_{ new_file_size_ }
     , status_{ FtpStatus::NTF }
+    , sent_status_{ FtpStatus::NTF }
     , device_id_{ device_id }
     , client_address_{ addr }
-    , total_packet_number_{ (new_file_size_ + static_cast<std::uint32_t>(sizeof(TrftpMessage::payload)) - 1) /
-                            static_cast<std::uint32_t>(sizeof(TrftpMessage::payload)) }
+    , notify_address_{ addr }
+    , payload_size_{ TRFTP_PAYLOAD_SIZE }
+    , probe_path_mtu_{ false }
+    , fast_handshake_{ false }
+    , speculative_psn_{ 0 }
+    , features_{ bundle_ ? (TRFTP_FEATURE_SACK | TRFTP_FEATURE_FEC | TRFTP_FEATURE_BUNDLE | TRFTP_FEATURE_LARGE_FILE)
+                         : (TRFTP_FEATURE_SACK | TRFTP_FEATURE_FEC | TRFTP_FEATURE_RESUME | TRFTP_FEATURE_DELTA |
+                            TRFTP_FEATURE_COMPRESSION | TRFTP_FEATURE_LARGE_FILE | TRFTP_FEATURE_HELD_PSNS) }
+    , total_packet_number_{ static_cast<std::uint32_t>((new_file_size_ + payload_size_ - 1) / payload_size_) }
     , packet_sequence_number_{ 0 }
     , retransmit_psn_{ std::numeric_limits<std::uint32_t>::max() }
+    , retransmit_psns_{}
     , cur_file_version_{ 0 }
-    , inter_packet_gap_{ std::chrono::microseconds(100) }
+    , receiver_drops_{ 0 }
+    , receive_window_{ 0 }
+    , acked_psn_{ 0 }
+    , fec_block_size_{ 0 }
+    , resume_psn_{ 0 }
+    , held_psns_{}
+    , congestion_algorithm_{ CongestionAlgorithm::AIMD }
+    , congestion_control_{ std::make_unique<FixedRateControl>(std::chrono::microseconds(TRAN_IPG_MIN),
+                                                              std::chrono::microseconds(TRAN_IPG_MAX)) }
+    , send_times_(TRAN_SEND_TIMES)
+    , request_sent_time_{ Timestamp::zero() }
+    , rtt_{}
 {
+    // PSNs are 32-bit, which is 2 TiB at the smallest payload size
+    if (new_file_size_ > std::uint64_t(std::numeric_limits<std::uint32_t>::max()) * TRFTP_MIN_PAYLOAD_SIZE)
+    {
+        throw std::runtime_error("File(" + file_path.string() + ") is too large");
+    }
 }
 
 ServerTransaction::ServerTransaction(ServerTransaction &&other) noexcept
     : file_path_{ std::move(other.file_path_) }
+    , file_source_{ std::move(other.file_source_) }
+    , bundle_{ std::move(other.bundle_) }
     , new_file_version_{ other.new_file_version_ }
     , new_file_size_{ other.new_file_size_ }
     , new_file_crc32_{ other.new_file_crc32_ }
+    , delta_base_{ std::move(other.delta_base_) }
+    , delta_{ std::move(other.delta_) }
+    , compressed_{ std::move(other.compressed_) }
+    , data_{ other.data_ }
+    , data_length_{ other.data_length_ }
     , status_{ other.status_.load() }
+    , sent_status_{ other.sent_status_.load() }
     , device_id_{ other.device_id_ }
     , client_address_{ other.client_address_ }
+    , notify_address_{ other.notify_address_ }
+    , payload_size_{ other.payload_size_ }
+    , probe_path_mtu_{ other.probe_path_mtu_ }
+    , fast_handshake_{ other.fast_handshake_ }
+    , speculative_psn_{ other.speculative_psn_ }
+    , features_{ other.features_ }
     , total_packet_number_{ other.total_packet_number_ }
     , packet_sequence_number_{ other.packet_sequence_number_.load() }
     , retransmit_psn_{ other.retransmit_psn_.load() }
+    , retransmit_psns_{ std::move(other.retransmit_psns_) }
     , cur_file_version_{ other.cur_file_version_ }
-    , inter_packet_gap_{ other.inter_packet_gap_ }
+    , receiver_drops_{ other.receiver_drops_.load() }
+    , receive_window_{ other.receive_window_.load() }
+    , acked_psn_{ other.acked_psn_.load() }
+    , fec_block_size_{ other.fec_block_size_ }
+    , resume_psn_{ other.resume_psn_ }
+    , held_psns_{ std::move(other.held_psns_) }
+    , congestion_algorithm_{ other.congestion_algorithm_ }
+    , congestion_control_{ std::move(other.congestion_control_) }
+    , send_times_{ std::move(other.send_times_) }
+    , request_sent_time_{ other.request_sent_time_.load() }
+    , rtt_{}
 {
 }
 
@@ -45,6 +102,96 @@ ServerTransaction::~ServerTransaction()
     }
 }
 
+void ServerTransaction::OfferPayloadSize(std::uint32_t payload_size, bool probe)
+{
+    payload_size_ = std::clamp(payload_size, TRFTP_MIN_PAYLOAD_SIZE, TRFTP_MAX_PAYLOAD_SIZE);
+    probe_path_mtu_ = probe && (payload_size_ > TRFTP_PAYLOAD_SIZE);
+}
+
+void ServerTransaction::OfferFastHandshake()
+{
+    fast_handshake_ = true;
+}
+
+bool ServerTransaction::AbandonPathMtuProbe()
+{
+    if (!probe_path_mtu_)
+    {
+        return false;
+    }
+
+    // The padded INFO was dropped on the path, so fall back to the default payload size
+    probe_path_mtu_ = false;
+    payload_size_ = TRFTP_PAYLOAD_SIZE;
+    return true;
+}
+
+bool ServerTransaction::AbandonFastHandshake()
+{
+    if (!fast_handshake_)
+    {
+        return false;
+    }
+
+    // Older clients cancel an NTF carrying INFO, so fall back to the full handshake. Whatever DATA went ahead is sent
+    // again after RDY.
+    fast_handshake_ = false;
+    speculative_psn_ = 0;
+    client_address_ = notify_address_;
+    return true;
+}
+
+void ServerTransaction::SetCongestionControl(CongestionAlgorithm algorithm)
+{
+    congestion_algorithm_ = algorithm;
+}
+
+bool ServerTransaction::PrepareDelta()
+{
+    // Only a version whose signature is cached can be the base of a delta. A directory, and a file too large for the
+    // 32-bit lengths of a delta, are sent as they are.
+    auto base = (cur_file_version_ != new_file_version_) ? FileSignature::Find(cur_file_version_) : nullptr;
+    if (!base || bundle_ || (new_file_size_ >= TRFTP_LENGTH_LARGE))
+    {
+        return false;
+    }
+
+    auto delta = base->Encode(file_source_->Data(), file_source_->Size(), new_file_crc32_);
+    if (delta->size() >= new_file_size_)
+    {
+        tout << ServerLog() << "Delta against version " << cur_file_version_ << " is no smaller than the file"
+             << std::endl;
+        return false;
+    }
+
+    tout << ServerLog() << "Offering a delta of " << delta->size() << " bytes against version " << cur_file_version_
+         << std::endl;
+    delta_base_ = std::move(base);
+    delta_ = std::move(delta);
+    return true;
+}
+
+bool ServerTransaction::PrepareCompression()
+{
+    // A directory, and a file too large for the 32-bit lengths of compressed blocks, are sent as they are
+    if (bundle_ || (new_file_size_ >= TRFTP_LENGTH_LARGE))
+    {
+        return false;
+    }
+
+    // Concurrent transactions of the same file compress it once
+    auto compressed = file_source_->Compressed();
+    if (compressed->size() >= new_file_size_)
+    {
+        tout << ServerLog() << "File does not compress, sending it as it is" << std::endl;
+        return false;
+    }
+
+    tout << ServerLog() << "Offering the file compressed to " << compressed->size() << " bytes" << std::endl;
+    compressed_ = std::move(compressed);
+    return true;
+}
+
 void ServerTransaction::SendMessage(MessageId id, UdpSocket &udp_socket)
 {
     if ((id != MessageId::NTF) && (id != MessageId::INFO) && (id != MessageId::DATA) && (id != MessageId::FIN) &&
@@ -54,34 +201,72 @@ void ServerTransaction::SendMessage(MessageId id, UdpSocket &udp_socket)
         return;
     }
 
+    // All of a small file may have gone ahead of RDY, and its DONE be in before DATA starts
+    if (auto expected = FtpStatus::RDY; (id == MessageId::DATA) && (speculative_psn_ > 0) &&
+                                        (speculative_psn_ == total_packet_number_) &&
+                                        !status_.compare_exchange_strong(expected, id))
+    {
+        sent_status_ = id;
+        return;
+    }
+
     status_ = id;
-    cv_.notify_one();
+    sent_status_ = id;
+    cv_.notify_all();
+
+    if (id == MessageId::DATA)
+    {
+        SendFileAsync(udp_socket);
+        return;
+    }
+    if ((id == MessageId::NTF) && fast_handshake_)
+    {
+        SendFastNotification(udp_socket);
+        return;
+    }
 
+    SendMessageTo(id, udp_socket, client_address_);
+}
+
+void ServerTransaction::SendMessageTo(MessageId id, UdpSocket &udp_socket, const sockaddr_in &addr)
+{
     auto payload_len = 0U;
     TrftpMessage msg;
 
     switch (id)
     {
     case MessageId::NTF:
-        payload_len += sizeof(TrftpNtf);
+        payload_len += fast_handshake_ ? sizeof(TrftpNtf) : TRFTP_LEGACY_NTF_SIZE;
         msg.ntf.new_file_version = new_file_version_;
+        if (fast_handshake_)
+        {
+            CompleteInfo(msg.ntf.info);
+        }
+
+        // Carrying INFO, NTF probes the path the same way
+        if (fast_handshake_ && probe_path_mtu_)
+        {
+            std::fill(msg.payload + payload_len, msg.payload + payload_size_, 0U);
+            payload_len = payload_size_;
+        }
         break;
 
     case MessageId::INFO:
         payload_len += sizeof(TrftpInfo);
-        msg.info.new_file_version = new_file_version_;
-        msg.info.file_length = new_file_size_;
-        msg.info.crc32 = new_file_crc32_;
+        CompleteInfo(msg.info);
+
+        // A full-sized INFO only reaches the client if the path carries DATA datagrams of the offered size
+        if (probe_path_mtu_)
+        {
+            std::fill(msg.payload + payload_len, msg.payload + payload_size_, 0U);
+            payload_len = payload_size_;
+        }
         break;
 
     case MessageId::FIN:
     case MessageId::CXL:
         break;
 
-    case MessageId::DATA:
-        SendFileAsync(udp_socket);
-        return;
-
     default:
         return;
     }
@@ -89,17 +274,61 @@ void ServerTransaction::SendMessage(MessageId id, UdpSocket &udp_socket)
     // Set up the message header
     CompleteHeader(msg, id, payload_len, 0U);
 
-    // Send the message
-    if (udp_socket.Send(msg, sizeof(TrftpHeader) + payload_len, client_address_))
+    // Send the message, remembering when requests left so their replies give an RTT sample
+    Timestamp tx_time;
+    if (udp_socket.Send(msg, sizeof(TrftpHeader) + payload_len, addr, &tx_time))
     {
-        PrintSendLog(msg);
+        if ((id == MessageId::NTF) || (id == MessageId::INFO))
+        {
+            request_sent_time_ = tx_time;
+        }
+
+        PrintSendLog(msg.header, addr);
     }
 }
 
-void ServerTransaction::OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr)
+void ServerTransaction::SendFastNotification(UdpSocket &udp_socket)
+{
+    // The first burst of DATA follows NTF before the client has replied, as RDY asks for it unless the client takes
+    // less than the offered payload size or resumes. RDY may be in while the burst is still going out and changes what
+    // DATA carries, so the burst is prepared before NTF.
+    std::array<TrftpHeader, TRAN_BURST_SIZE> headers;
+    std::array<const std::uint8_t *, TRAN_BURST_SIZE> payloads;
+    std::array<std::size_t, TRAN_BURST_SIZE> payload_lens;
+    const auto total_packet_number = static_cast<std::uint32_t>((data_length_ + payload_size_ - 1) / payload_size_);
+    speculative_psn_ = compressed_ ? 0U : std::min(TRAN_BURST_SIZE, total_packet_number);
+    for (std::uint32_t psn = 0; psn < speculative_psn_; psn++)
+    {
+        const auto file_offset = std::uint64_t(psn) * payload_size_;
+        payload_lens[psn] = std::min<std::uint64_t>(payload_size_, data_length_ - file_offset);
+        payloads[psn] = Payload(psn, payload_lens[psn]);
+        CompleteHeader(headers[psn], payloads[psn], MessageId::DATA, data_length_, psn);
+    }
+
+    // RDY comes from the transaction's own port, which the client only takes DATA on once it asked for it. So the burst
+    // goes where NTF does even if RDY is in already.
+    SendMessageTo(MessageId::NTF, udp_socket, notify_address_);
+    if (speculative_psn_ == 0)
+    {
+        return;
+    }
+
+    auto sent_count = udp_socket.SendSegmented(headers.data(), payloads.data(), payload_lens.data(), speculative_psn_,
+                                               notify_address_);
+    for (std::size_t i = 0; i < sent_count; i++)
+    {
+        PrintSendLog(headers[i], notify_address_);
+    }
+
+    // The headers live on this stack, so wait until the kernel is done with them
+    udp_socket.WaitZeroCopy(udp_socket.ZeroCopyTicket(), std::chrono::seconds(1));
+}
+
+void ServerTransaction::OnReceive(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr,
+                                  Timestamp rx_time)
 {
     client_address_ = addr;
-    PrintRecvLog(msg);
+    PrintRecvLog(msg, addr);
 
     if (!ValidateMessageIntegrity(msg, len))
     {
@@ -124,10 +353,15 @@ void ServerTransaction::OnReceive(const TrftpMessage &msg, std::size_t len, cons
         }
 
         cur_file_version_ = msg.chk.cur_file_version;
+        rtt_.AddSample(request_sent_time_, rx_time);
         break;
 
     case MessageId::RDY:
-        if (status_ != FtpStatus::INFO)
+    {
+        // RDY to an NTF carrying INFO stands for CHK as well
+        const auto fast_reply =
+            (status_ == FtpStatus::NTF) && fast_handshake_ && (payload_len >= offsetof(TrftpRdy, held_psns));
+        if ((status_ != FtpStatus::INFO) && !fast_reply)
         {
             terr << ServerLog() << "Transaction state is not <INFO>. Discarding..." << std::endl;
             return;
@@ -136,23 +370,112 @@ void ServerTransaction::OnReceive(const TrftpMessage &msg, std::size_t len, cons
         {
             return;
         }
+        if (fast_reply)
+        {
+            cur_file_version_ = msg.rdy.cur_file_version;
+        }
+
+        // Older clients do not choose a payload size and always use the default one
+        const auto offered_payload_size = payload_size_;
+        payload_size_ = (payload_len > TRFTP_LEGACY_RDY_SIZE) ? msg.rdy.payload_size : TRFTP_PAYLOAD_SIZE;
+
+        // A client taking the delta rebuilds the file from it and its current version
+        if ((payload_len >= offsetof(TrftpRdy, compressed_length)) && (msg.rdy.delta_length > 0))
+        {
+            data_ = delta_->data();
+            data_length_ = delta_->size();
+            tout << ServerLog() << "Sending a delta of " << data_length_ << " bytes instead of " << new_file_size_
+                 << std::endl;
+        }
+        else if ((payload_len >= offsetof(TrftpRdy, bundle_files)) && (msg.rdy.compressed_length > 0))
+        {
+            data_ = compressed_->data();
+            data_length_ = compressed_->size();
+            tout << ServerLog() << "Sending the file compressed to " << data_length_ << " bytes instead of "
+                 << new_file_size_ << std::endl;
+        }
+        else
+        {
+            data_ = bundle_ ? nullptr : file_source_->Data();
+            data_length_ = new_file_size_;
+        }
+        if (bundle_)
+        {
+            tout << ServerLog() << "Sending a directory of " << bundle_->FileCount() << " files in " << data_length_
+                 << " bytes" << std::endl;
+        }
+        total_packet_number_ = static_cast<std::uint32_t>((data_length_ + payload_size_ - 1) / payload_size_);
+
+        // Clients without SACK never acknowledge DATA, so their transfer cannot be bounded by a window
+        receive_window_ = (payload_len >= offsetof(TrftpRdy, fec_block_size)) ? msg.rdy.receive_window : 0U;
+        fec_block_size_ = (payload_len >= offsetof(TrftpRdy, resume_psn)) ? msg.rdy.fec_block_size : 0U;
+        if (fec_block_size_ > 0)
+        {
+            tout << ServerLog() << "Sending a parity packet per " << fec_block_size_ << " DATA packets" << std::endl;
+        }
+
+        // A client holding part of the file from an interrupted transfer has acknowledged it already
+        resume_psn_ = (payload_len >= offsetof(TrftpRdy, delta_length)) ? msg.rdy.resume_psn : 0U;
+        acked_psn_ = resume_psn_;
+        if (resume_psn_ > 0)
+        {
+            tout << ServerLog() << "Resuming the transfer at PSN " << resume_psn_ << " of " << total_packet_number_
+                 << std::endl;
+        }
 
-        inter_packet_gap_ = std::chrono::microseconds(std::clamp(msg.rdy.inter_packet_gap, TRAN_IPG_MIN, TRAN_IPG_MAX));
+        // The PSNs it holds past the first hole are skipped the same way
+        held_psns_.assign(8 * (payload_len - std::min(payload_len, offsetof(TrftpRdy, held_psns))), false);
+        std::uint32_t held_count = 0;
+        for (std::size_t i = 0; i < held_psns_.size(); i++)
+        {
+            held_psns_[i] = msg.rdy.held_psns[i / 8] & (1U << (i % 8));
+            held_count += held_psns_[i] ? 1U : 0U;
+        }
+        if (held_count > 0)
+        {
+            tout << ServerLog() << "Skipping " << held_count << " DATA packets the client holds past it" << std::endl;
+        }
+
+        // DATA sent ahead was the whole file from PSN 0 at the offered payload size, the client drops anything else
+        if ((payload_size_ != offered_payload_size) || (data_length_ != new_file_size_) || (resume_psn_ != 0))
+        {
+            speculative_psn_ = 0;
+        }
+        if (speculative_psn_ > 0)
+        {
+            tout << ServerLog() << "Client took " << speculative_psn_ << " DATA packets sent ahead" << std::endl;
+        }
+
+        // The gap the client asks for is only where pacing starts, the controller takes it from there
+        {
+            std::scoped_lock lock(mtx_);
+            congestion_control_ = CreateCongestionControl(
+                congestion_algorithm_,
+                std::chrono::microseconds(std::clamp(msg.rdy.inter_packet_gap, TRAN_IPG_MIN, TRAN_IPG_MAX)));
+            std::fill(send_times_.begin(), send_times_.end(), CongestionControl::Clock::time_point{});
+        }
+
+        rtt_.AddSample(request_sent_time_, rx_time);
+        if (auto rtt = PathRtt(); rtt)
+        {
+            tout << ServerLog() << "Path RTT is " << rtt->count() << " usec" << std::endl;
+        }
         break;
+    }
 
     case MessageId::DONE:
-        if (status_ != FtpStatus::DATA)
+        if ((status_ != FtpStatus::DATA) && ((status_ != FtpStatus::RDY) || (speculative_psn_ != total_packet_number_)))
         {
             terr << ServerLog() << "Transaction state is not <DATA>. Discarding..." << std::endl;
             return;
         }
-        if (packet_sequence_number_ != total_packet_number_)
+        if (std::max(packet_sequence_number_.load(), speculative_psn_) != total_packet_number_)
         {
             terr << ServerLog() << "Transaction PSN (" << packet_sequence_number_ << ") does not match expected TPN ("
                  << total_packet_number_ << "). Discarding..." << std::endl;
             return;
         }
-        if (!ValidateMessage(msg.done, payload_len, TrftpDone{ new_file_version_, new_file_size_, new_file_crc32_ }))
+        if (!ValidateMessage(msg.done, payload_len, ExpectedDone()))
         {
             return;
         }
@@ -171,12 +494,53 @@ void ServerTransaction::OnReceive(const TrftpMessage &msg, std::size_t len, cons
             terr << ServerLog() << "Transaction state is not <DATA>. Discarding..." << std::endl;
             return;
         }
-        if (!ValidateMessage(msg.rtx, payload_len, TrftpRtx{ packet_sequence_number_ }))
+        if (!ValidateMessage(msg.rtx, payload_len, TrftpRtx{ packet_sequence_number_, 0 }))
         {
             return;
         }
 
+        if (payload_len == sizeof(TrftpRtx))
+        {
+            UpdateReceiverDrops(msg.rtx.receive_drops);
+        }
+
+        {
+            std::scoped_lock lock(mtx_);
+            congestion_control_->OnLoss(1, CongestionControl::Clock::now());
+        }
+
         retransmit_psn_ = msg.rtx.retransmit_psn;
+        cv_.notify_all();
+        return;
+
+    case MessageId::SACK:
+        if (status_ != FtpStatus::DATA)
+        {
+            terr << ServerLog() << "Transaction state is not <DATA>. Discarding..." << std::endl;
+            return;
+        }
+        if (!ValidateMessage(msg.sack, payload_len))
+        {
+            return;
+        }
+
+        UpdateReceiverDrops(msg.sack.receive_drops);
+
+        {
+            std::scoped_lock lock(mtx_);
+            const auto now = CongestionControl::Clock::now();
+            AcknowledgeData(msg.sack.base_psn, now);
+            if (msg.sack.receive_window > 0)
+            {
+                receive_window_ = msg.sack.receive_window;
+            }
+
+            if (auto lost = QueueRetransmits(msg.sack); lost > 0)
+            {
+                congestion_control_->OnLoss(lost, now);
+            }
+        }
+        cv_.notify_all();
         return;
 
     default:
@@ -185,12 +549,88 @@ void ServerTransaction::OnReceive(const TrftpMessage &msg, std::size_t len, cons
     }
 
     status_ = id;
-    cv_.notify_one();
+    cv_.notify_all();
+}
+
+void ServerTransaction::AcknowledgeData(std::uint32_t acked_psn, CongestionControl::Clock::time_point now)
+{
+    if (acked_psn <= acked_psn_)
+    {
+        return;
+    }
+
+    // The newest acknowledged PSN gives an RTT sample, unless it was retransmitted (Karn's rule)
+    std::chrono::nanoseconds rtt{ 0 };
+    const auto sent_psn = std::min(packet_sequence_number_.load(), total_packet_number_);
+    const auto newest_psn = acked_psn - 1;
+    if (const auto sent = send_times_[newest_psn % TRAN_SEND_TIMES];
+        (sent_psn - newest_psn <= TRAN_SEND_TIMES) && (sent != CongestionControl::Clock::time_point{}))
+    {
+        rtt = now - sent;
+    }
+
+    congestion_control_->OnAck(acked_psn - acked_psn_, rtt, now);
+    acked_psn_ = acked_psn;
+}
+
+std::uint32_t ServerTransaction::QueueRetransmits(const TrftpSack &sack)
+{
+    // Queue only what has been sent already, the rest goes out in order anyway
+    const auto sent_psn = std::min(packet_sequence_number_.load(), total_packet_number_);
+
+    std::uint32_t lost = 0;
+    for (std::uint32_t i = 0; (i < sack.bitmap_bits) && (sack.base_psn + i < sent_psn); i++)
+    {
+        if ((sack.bitmap[i / 8] & (1U << (i % 8))) && retransmit_psns_.insert(sack.base_psn + i).second)
+        {
+            lost++;
+        }
+    }
+
+    return lost;
 }
 
-std::optional<FtpStatus> ServerTransaction::WaitForStatus(std::chrono::seconds timeout)
+void ServerTransaction::UpdateReceiverDrops(std::uint32_t receive_drops)
 {
-    auto old_status = status_.load();
+    // Drops in the client's socket buffer mean we outran the receiver rather than lost packets on the wire
+    if (receive_drops > receiver_drops_)
+    {
+        std::unique_lock lock(mtx_);
+        congestion_control_->OnReceiverDrops(receive_drops - receiver_drops_.exchange(receive_drops),
+                                             CongestionControl::Clock::now());
+        const auto gap = std::chrono::duration_cast<std::chrono::microseconds>(congestion_control_->InterPacketGap());
+        lock.unlock();
+
+        terr << ServerLog() << "Client dropped " << receive_drops << " datagrams in its receive buffer. IPG is now "
+             << gap.count() << " usec" << std::endl;
+    }
+}
+
+std::uint32_t ServerTransaction::ReceiverDrops() const
+{
+    return receiver_drops_;
+}
+
+std::chrono::milliseconds ServerTransaction::ResponseTimeout() const
+{
+    return std::chrono::ceil<std::chrono::milliseconds>(
+        rtt_.Timeout(TRAN_RESPONSE_TIMEOUT_MIN, TRAN_RESPONSE_TIMEOUT_MAX));
+}
+
+std::optional<std::chrono::microseconds> ServerTransaction::PathRtt() const
+{
+    if (auto srtt = rtt_.SmoothedRtt(); srtt)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(*srtt);
+    }
+
+    return std::nullopt;
+}
+
+std::optional<FtpStatus> ServerTransaction::WaitForStatus(std::chrono::milliseconds timeout)
+{
+    // Compare against the last sent status, since the reply may have arrived before we started waiting
+    auto old_status = sent_status_.load();
 
     if (std::unique_lock lock(mtx_); cv_.wait_for(lock, timeout, [this, old_status]() { return status_ != old_status; }))
     {
@@ -202,87 +642,211 @@ std::optional<FtpStatus> ServerTransaction::WaitForStatus(std::chrono::seconds t
 
 void ServerTransaction::SendFileAsync(UdpSocket &udp_socket)
 {
+    // DATA is sent from a thread of its own rather than from the server's reactor. Bursts are paced down to gaps of
+    // a few microseconds and may block on a bundle's CRC32 or on zero-copy slots, which would hold up the SACKs and
+    // RTXs of every other transaction the reactor receives. A sender also takes a core of its own at full rate.
     thr_ = std::thread([this, &udp_socket]() {
-        std::ifstream ifs(file_path_, std::ios::binary);
+        // With zero-copy sends the kernel reads the headers after SendSegmented() returns, so the bursts rotate
+        // through several header slots and a slot is refilled only once the kernel has released it. FEC payloads are
+        // computed, not mapped, so they rotate through parity slots the same way.
+        std::array<std::array<TrftpHeader, TRAN_BURST_SIZE + TRAN_BURST_PARITY>, TRAN_ZEROCOPY_BURSTS> header_slots;
+        std::array<std::uint32_t, TRAN_ZEROCOPY_BURSTS> slot_tickets;
+        std::array<const std::uint8_t *, TRAN_BURST_SIZE + TRAN_BURST_PARITY> payloads;
+        std::array<std::size_t, TRAN_BURST_SIZE + TRAN_BURST_PARITY> payload_lens;
+        std::array<std::uint32_t, TRAN_BURST_SIZE> psns;
+        std::vector<std::uint8_t> parity_slots(
+            (fec_block_size_ > 0) ? std::size_t(TRAN_ZEROCOPY_BURSTS) * TRAN_BURST_PARITY * payload_size_ : 0);
+        std::size_t slot = 0;
 
-        if (!ifs.is_open())
-        {
-            SendMessage(MessageId::CXL, udp_socket);
-            return;
-        }
+        slot_tickets.fill(udp_socket.ZeroCopyTicket());
 
-        for (packet_sequence_number_ = 0; packet_sequence_number_ < total_packet_number_; packet_sequence_number_++)
+        packet_sequence_number_ = std::max(resume_psn_, speculative_psn_);
+        while (status_ != FtpStatus::CXL)
         {
             auto now = std::chrono::steady_clock::now();
 
-            // 1. Check for CXL (Cancellation Request)
-            if (status_ == FtpStatus::CXL)
-            {
-                ifs.close();
-                return;
-            }
-
-            // 2. Check for RTX (Retransmission Request)
+            // 1. Check for RTX (go-back-N retransmission request from older clients)
             if (retransmit_psn_ != -1U)
             {
                 packet_sequence_number_.store(retransmit_psn_.exchange(-1));
             }
 
-            // 3. Prepare DATA message
-            std::uint32_t file_offset = packet_sequence_number_ * sizeof(TrftpData);
-            std::uint32_t payload_len = sizeof(TrftpData);
-            if (packet_sequence_number_ == total_packet_number_ - 1)
+            // 2. Once everything has been sent, wait for the client to report what is still missing
+            if (packet_sequence_number_ == total_packet_number_)
             {
-                payload_len = new_file_size_ - file_offset;
+                std::unique_lock lock(mtx_);
+                if (!cv_.wait_for(lock, ResponseTimeout(),
+                                  [this]() {
+                                      return (retransmit_psn_ != -1U) || !retransmit_psns_.empty() ||
+                                             (status_ != FtpStatus::DATA);
+                                  }) ||
+                    (status_ != FtpStatus::DATA))
+                {
+                    break;
+                }
+                if (retransmit_psn_ != -1U)
+                {
+                    packet_sequence_number_.store(retransmit_psn_.exchange(-1));
+                }
             }
 
-            TrftpMessage msg;
-            if (!ifs.seekg(file_offset).read(msg.data.new_file_data, payload_len))
+            // 3. Prepare a burst of DATA messages, packets reported missing by SACK first and then new ones.
+            //    The payloads point straight into the file mapping.
+            auto &headers = header_slots[slot];
+            udp_socket.WaitZeroCopy(slot_tickets[slot], std::chrono::seconds(1));
+
+            std::size_t burst_count = 0;
             {
-                SendMessage(MessageId::CXL, udp_socket);
-                ifs.close();
-                return;
+                std::scoped_lock lock(mtx_);
+                for (; (burst_count < psns.size()) && !retransmit_psns_.empty(); burst_count++)
+                {
+                    psns[burst_count] = retransmit_psns_.extract(retransmit_psns_.begin()).value();
+                    send_times_[psns[burst_count] % TRAN_SEND_TIMES] = {};
+                }
             }
+            const auto retransmit_count = burst_count;
+            std::size_t parity_count = 0;
+            for (; (burst_count < psns.size()) && (packet_sequence_number_ < total_packet_number_) &&
+                   ((receive_window_ == 0) || (packet_sequence_number_ < acked_psn_ + receive_window_));
+                 packet_sequence_number_++)
+            {
+                // A resuming client holds some of the packets past its first hole already
+                if (const auto held = packet_sequence_number_ - resume_psn_;
+                    (held < held_psns_.size()) && held_psns_[held])
+                {
+                    continue;
+                }
 
-            // 3. Send DATA message
-            CompleteHeader(msg, MessageId::DATA, new_file_size_, packet_sequence_number_);
+                // Every block a new PSN closes adds its parity, which has to fit into the slot as well. PSNs in a
+                // row close no more than TRAN_BURST_PARITY, the ones left between held PSNs may close more.
+                const bool closes_block =
+                    (fec_block_size_ > 0) && (((packet_sequence_number_ + 1) % fec_block_size_ == 0) ||
+                                              (packet_sequence_number_ == total_packet_number_ - 1));
+                if (closes_block && (parity_count == TRAN_BURST_PARITY))
+                {
+                    break;
+                }
+                parity_count += closes_block ? 1 : 0;
+                psns[burst_count++] = packet_sequence_number_;
+            }
 
-            // Send the message
-            if (udp_socket.Send(msg, sizeof(TrftpHeader) + payload_len, client_address_))
+            // With the receive window full, wait for the client to acknowledge (or report) more DATA
+            if (burst_count == 0)
             {
-                PrintSendLog(msg);
+                std::unique_lock lock(mtx_);
+                cv_.wait_for(lock, ResponseTimeout(), [this]() {
+                    return (packet_sequence_number_ < acked_psn_ + receive_window_) || (retransmit_psn_ != -1U) ||
+                           !retransmit_psns_.empty() || (status_ != FtpStatus::DATA);
+                });
+                continue;
             }
 
-            // 4. Wait for the case where the client requests a retransmission near the end of the file
-            if (packet_sequence_number_ == total_packet_number_ - 1)
+            std::size_t message_count = 0;
+            for (std::size_t i = 0; i < burst_count; i++)
             {
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-                if (retransmit_psn_ != -1U)
+                std::uint64_t file_offset = std::uint64_t(psns[i]) * payload_size_;
+                std::uint32_t payload_len = payload_size_;
+                if (psns[i] == total_packet_number_ - 1)
                 {
-                    packet_sequence_number_.store(retransmit_psn_.exchange(-1));
+                    payload_len = static_cast<std::uint32_t>(data_length_ - file_offset);
+                }
+
+                payloads[message_count] = Payload(psns[i], payload_len);
+                payload_lens[message_count] = payload_len;
+                CompleteHeader(headers[message_count], payloads[message_count], MessageId::DATA, data_length_,
+                               psns[i]);
+                message_count++;
+
+                // Close every block of new DATA with its parity, so the client can rebuild one lost packet of the
+                // block before it reports the hole
+                if ((fec_block_size_ > 0) && (i >= retransmit_count) &&
+                    (((psns[i] + 1) % fec_block_size_ == 0) || (psns[i] == total_packet_number_ - 1)))
+                {
+                    const auto first_psn = psns[i] - psns[i] % fec_block_size_;
+                    const auto parity_index = slot * TRAN_BURST_PARITY + (message_count - i - 1);
+                    auto *parity = parity_slots.data() + parity_index * payload_size_;
+                    CalculateBlockParity(first_psn, parity);
+
+                    payloads[message_count] = parity;
+                    payload_lens[message_count] = (first_psn == total_packet_number_ - 1) ? payload_len : payload_size_;
+                    CompleteHeader(headers[message_count], parity, MessageId::FEC, data_length_, first_psn);
+                    message_count++;
                 }
             }
 
-            std::this_thread::sleep_until(now + std::chrono::microseconds(inter_packet_gap_));
+            // 4. Send the burst of DATA messages (as one GSO super-buffer if enabled)
+            auto sent_count = udp_socket.SendSegmented(headers.data(), payloads.data(), payload_lens.data(),
+                                                       message_count, client_address_);
+            slot_tickets[slot] = udp_socket.ZeroCopyTicket();
+            slot = (slot + 1) % header_slots.size();
+            for (std::size_t i = 0; i < sent_count; i++)
+            {
+                PrintSendLog(headers[i], client_address_);
+            }
+
+            // Pacing is applied per burst, keeping the same average rate as per-packet pacing
+            std::chrono::nanoseconds gap;
+            {
+                std::scoped_lock lock(mtx_);
+                const auto sent_time = CongestionControl::Clock::now();
+                for (std::size_t i = retransmit_count; i < burst_count; i++)
+                {
+                    send_times_[psns[i] % TRAN_SEND_TIMES] = sent_time;
+                }
+                gap = congestion_control_->InterPacketGap();
+            }
+            std::this_thread::sleep_until(now + gap * message_count);
         }
 
-        ifs.close();
+        // The headers live on this thread's stack, so wait until the kernel is done with the last burst
+        udp_socket.WaitZeroCopy(slot_tickets[(slot + header_slots.size() - 1) % header_slots.size()],
+                                std::chrono::seconds(1));
     });
 }
 
-void ServerTransaction::CompleteHeader(TrftpMessage &msg, const MessageId xid, const std::uint32_t tpl,
+void ServerTransaction::CalculateBlockParity(std::uint32_t first_psn, std::uint8_t *parity) const
+{
+    // A shorter last packet is zero-padded, which leaves the parity as it is
+    const auto end_psn = std::min(first_psn + fec_block_size_, total_packet_number_);
+    std::fill(parity, parity + payload_size_, 0U);
+    for (auto psn = first_psn; psn < end_psn; psn++)
+    {
+        const auto file_offset = std::uint64_t(psn) * payload_size_;
+        const auto len = std::min<std::uint64_t>(payload_size_, data_length_ - file_offset);
+        CalculateParity(parity, Payload(psn, len), len);
+    }
+}
+
+const std::uint8_t *ServerTransaction::Payload(std::uint32_t psn, std::size_t len) const
+{
+    // A directory is sent from the mappings of its files, which may have to wait for the CRC32 of a file it ends
+    const auto offset = std::uint64_t(psn) * payload_size_;
+    return bundle_ ? bundle_->Payload(offset, len) : data_ + offset;
+}
+
+void ServerTransaction::CompleteHeader(TrftpMessage &msg, const MessageId xid, const std::uint64_t tpl,
                                        const std::uint32_t psn) const
 {
-    msg.header.magic = TRFTP_MAGIC;
-    msg.header.spid = 0xFD00U;
-    msg.header.dpid = device_id_;
-    msg.header.xid = std::uint32_t(xid);
-    msg.header.tpn = (tpl == 0) ? 1U : (tpl + sizeof(TrftpMessage::payload) - 1) / sizeof(TrftpMessage::payload);
-    msg.header.tpl = tpl;
-    msg.header.psn = psn;
-    msg.header.pl = psn == (msg.header.tpn - 1) ? (tpl % sizeof(TrftpMessage::payload)) : sizeof(TrftpMessage::payload);
-    msg.header.crc32 = 0U;
-    msg.header.crc32 = CalculateCrc32(reinterpret_cast<std::uint8_t *>(&msg), sizeof(TrftpHeader) + msg.header.pl, 0U);
+    CompleteHeader(msg.header, msg.payload, xid, tpl, psn);
+}
+
+void ServerTransaction::CompleteHeader(TrftpHeader &header, const std::uint8_t *payload, const MessageId xid,
+                                       const std::uint64_t tpl, const std::uint32_t psn) const
+{
+    header.magic = TRFTP_MAGIC;
+    header.spid = 0xFD00U;
+    header.dpid = device_id_;
+    header.xid = std::uint32_t(xid);
+    header.tpn = (tpl == 0) ? 1U : static_cast<std::uint32_t>((tpl + payload_size_ - 1) / payload_size_);
+    header.tpl = static_cast<std::uint32_t>(tpl);
+    header.psn = psn;
+    header.pl = psn == (header.tpn - 1) ? static_cast<std::uint32_t>(tpl - std::uint64_t(psn) * payload_size_)
+                                        : payload_size_;
+    header.crc32 = 0U;
+
+    // The payload may live apart from the header (e.g. in the file mapping), so chain the CRC over both
+    auto crc32 = CalculateCrc32(reinterpret_cast<std::uint8_t *>(&header), sizeof(TrftpHeader), 0U);
+    header.crc32 = CalculateCrc32(payload, header.pl, crc32);
 }
 
 bool ServerTransaction::ValidateMessageIntegrity(const TrftpMessage &msg, std::size_t len) const
@@ -335,17 +899,84 @@ bool ServerTransaction::ValidateMessage(const TrftpChk &payload, std::size_t pay
 }
 bool ServerTransaction::ValidateMessage(const TrftpRdy &payload, std::size_t payload_len) const
 {
-    if (payload_len != sizeof(payload))
+    if (((payload_len < offsetof(TrftpRdy, held_psns)) || (payload_len > sizeof(payload))) &&
+        (payload_len != offsetof(TrftpRdy, bundle_files)) &&
+        (payload_len != offsetof(TrftpRdy, compressed_length)) &&
+        (payload_len != offsetof(TrftpRdy, delta_length)) && (payload_len != offsetof(TrftpRdy, resume_psn)) &&
+        (payload_len != offsetof(TrftpRdy, fec_block_size)) && (payload_len != offsetof(TrftpRdy, receive_window)) &&
+        (payload_len != offsetof(TrftpRdy, large_file_length)) &&
+        (payload_len != offsetof(TrftpRdy, cur_file_version)) && (payload_len != TRFTP_LEGACY_RDY_SIZE))
     {
         terr << ServerLog() << "Invalid message length for <RDY>. Discarding..." << std::endl;
         return false;
     }
+    if ((payload_len >= offsetof(TrftpRdy, resume_psn)) && (payload.fec_block_size != 0) &&
+        ((payload.fec_block_size < TRFTP_FEC_MIN_BLOCK_SIZE) || (payload.fec_block_size > TRFTP_FEC_MAX_BLOCK_SIZE) ||
+         (payload.receive_window == 0)))
+    {
+        terr << ServerLog() << "Requested FEC block size (" << payload.fec_block_size << ") is not within ["
+             << TRFTP_FEC_MIN_BLOCK_SIZE << ", " << TRFTP_FEC_MAX_BLOCK_SIZE << "] or lacks SACK. Discarding..."
+             << std::endl;
+        return false;
+    }
+    if ((payload_len > TRFTP_LEGACY_RDY_SIZE) &&
+        ((payload.payload_size < TRFTP_MIN_PAYLOAD_SIZE) || (payload.payload_size > payload_size_)))
+    {
+        terr << ServerLog() << "Requested payload size (" << payload.payload_size << ") is not within ["
+             << TRFTP_MIN_PAYLOAD_SIZE << ", " << payload_size_ << "]. Discarding..." << std::endl;
+        return false;
+    }
+    if ((payload_len >= offsetof(TrftpRdy, delta_length)) && (payload.resume_psn != 0) &&
+        ((payload.receive_window == 0) ||
+         (payload.resume_psn >= (new_file_size_ + payload.payload_size - 1) / payload.payload_size)))
+    {
+        terr << ServerLog() << "Resume PSN (" << payload.resume_psn << ") is past the last DATA or lacks SACK. Discarding..."
+             << std::endl;
+        return false;
+    }
+    if ((payload_len > offsetof(TrftpRdy, held_psns)) &&
+        (!(features_ & TRFTP_FEATURE_HELD_PSNS) || (payload.receive_window == 0) || (payload.delta_length != 0) ||
+         (payload.compressed_length != 0)))
+    {
+        terr << ServerLog() << "Held PSNs were listed without resuming the whole file with SACK. Discarding..."
+             << std::endl;
+        return false;
+    }
+    if ((payload_len >= offsetof(TrftpRdy, compressed_length)) && (payload.delta_length != 0) &&
+        (!delta_ || (payload.delta_length != delta_->size()) || (payload.resume_psn != 0)))
+    {
+        terr << ServerLog() << "Requested delta length (" << payload.delta_length << ") was not offered. Discarding..."
+             << std::endl;
+        return false;
+    }
+    if ((payload_len >= offsetof(TrftpRdy, bundle_files)) && (payload.compressed_length != 0) &&
+        (!compressed_ || (payload.compressed_length != compressed_->size()) || (payload.delta_length != 0) ||
+         (payload.resume_psn != 0)))
+    {
+        terr << ServerLog() << "Requested compressed length (" << payload.compressed_length
+             << ") was not offered. Discarding..." << std::endl;
+        return false;
+    }
+    if (((payload_len >= offsetof(TrftpRdy, large_file_length)) ? payload.bundle_files : 0U) !=
+        (bundle_ ? bundle_->FileCount() : 0U))
+    {
+        terr << ServerLog() << "Client cannot take a directory of " << (bundle_ ? bundle_->FileCount() : 0U)
+             << " files. Discarding..." << std::endl;
+        return false;
+    }
+    if ((new_file_size_ >= TRFTP_LENGTH_LARGE) &&
+        ((payload_len < offsetof(TrftpRdy, cur_file_version)) || (payload.large_file_length != new_file_size_)))
+    {
+        terr << ServerLog() << "Client cannot take a file of " << new_file_size_ << " bytes. Discarding..."
+             << std::endl;
+        return false;
+    }
 
     return true;
 }
 bool ServerTransaction::ValidateMessage(const TrftpDone &payload, std::size_t payload_len, const TrftpDone &expected) const
 {
-    if (payload_len != sizeof(payload))
+    if ((payload_len != sizeof(payload)) && (payload_len != TRFTP_LEGACY_DONE_SIZE))
     {
         terr << ServerLog() << "Invalid message length for <DONE>. Discarding..." << std::endl;
         return false;
@@ -356,10 +987,12 @@ bool ServerTransaction::ValidateMessage(const TrftpDone &payload, std::size_t pa
              << ") does not match expected version (" << payload.new_file_version << "). Discarding..." << std::endl;
         return false;
     }
-    if (payload.file_length != expected.file_length)
+    // Older clients only report 32 bits of the length, which only stands for files below 4 GiB
+    const auto file_length = (payload_len == sizeof(payload)) ? payload.large_file_length : payload.file_length;
+    if ((payload.file_length != expected.file_length) || (file_length != expected.large_file_length))
     {
-        terr << ServerLog() << "Transaction file length (" << expected.file_length << ") does not match expected length ("
-             << payload.file_length << "). Discarding..." << std::endl;
+        terr << ServerLog() << "Transaction file length (" << expected.large_file_length
+             << ") does not match expected length (" << file_length << "). Discarding..." << std::endl;
         return false;
     }
     if (payload.crc32 != expected.crc32)
@@ -383,7 +1016,7 @@ bool ServerTransaction::ValidateMessage(const TrftpCxl &payload, std::size_t pay
 }
 bool ServerTransaction::ValidateMessage(const TrftpRtx &payload, std::size_t payload_len, const TrftpRtx &expected) const
 {
-    if (payload_len != sizeof(payload))
+    if ((payload_len != sizeof(payload)) && (payload_len != TRFTP_LEGACY_RTX_SIZE))
     {
         terr << ServerLog() << "Invalid message length for <RTX>. Discarding..." << std::endl;
         return false;
@@ -398,7 +1031,61 @@ bool ServerTransaction::ValidateMessage(const TrftpRtx &payload, std::size_t pay
     return true;
 }
 
-void ServerTransaction::PrintRecvLog(const TrftpMessage &msg) const
+bool ServerTransaction::ValidateMessage(const TrftpSack &payload, std::size_t payload_len) const
+{
+    // A SACK may be padded past its bitmap, which still holds no more than TRFTP_SACK_BITMAP_SIZE bytes
+    if ((payload_len < offsetof(TrftpSack, bitmap)) ||
+        (payload.bitmap_bits > 8 * (payload_len - offsetof(TrftpSack, bitmap))) ||
+        (payload.bitmap_bits > 8 * TRFTP_SACK_BITMAP_SIZE))
+    {
+        terr << ServerLog() << "Invalid message length for <SACK>. Discarding..." << std::endl;
+        return false;
+    }
+    if (payload.base_psn > total_packet_number_)
+    {
+        terr << ServerLog() << "Acknowledged PSN (" << payload.base_psn << ") is greater than TPN ("
+             << total_packet_number_ << "). Discarding..." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+std::unique_ptr<CongestionControl> ServerTransaction::CreateCongestionControl(CongestionAlgorithm algorithm,
+                                                                              std::chrono::nanoseconds initial_gap) const
+{
+    // Without SACK nothing acknowledges DATA, so only the client's receive drops can slow the transfer down
+    if ((algorithm == CongestionAlgorithm::FIXED) || (receive_window_ == 0))
+    {
+        return std::make_unique<FixedRateControl>(initial_gap, std::chrono::microseconds(TRAN_IPG_MAX));
+    }
+
+    return CongestionControl::Create(algorithm, initial_gap);
+}
+
+void ServerTransaction::CompleteInfo(TrftpInfo &info) const
+{
+    info.new_file_version = new_file_version_;
+    info.file_length = ExpectedDone().file_length;
+    info.crc32 = new_file_crc32_;
+    info.payload_size = payload_size_;
+    info.features = features_;
+    info.delta_length = delta_ ? delta_->size() : 0U;
+    info.delta_base_length = delta_base_ ? delta_base_->Size() : 0U;
+    info.delta_base_crc32 = delta_base_ ? delta_base_->Crc32() : 0U;
+    info.compressed_length = compressed_ ? compressed_->size() : 0U;
+    info.bundle_files = bundle_ ? bundle_->FileCount() : 0U;
+    info.large_file_length = new_file_size_;
+}
+
+TrftpDone ServerTransaction::ExpectedDone() const
+{
+    // The 32-bit length saturates for files of 4 GiB and more, which only clients of LARGE_FILE can take
+    const auto file_length = static_cast<std::uint32_t>(std::min<std::uint64_t>(new_file_size_, TRFTP_LENGTH_LARGE));
+    return TrftpDone{ new_file_version_, file_length, new_file_crc32_, new_file_size_ };
+}
+
+void ServerTransaction::PrintRecvLog(const TrftpMessage &msg, const sockaddr_in &addr) const
 {
     // TODO: DUMP message
 
@@ -415,6 +1102,9 @@ void ServerTransaction::PrintRecvLog(const TrftpMessage &msg) const
     case MessageId::RTX:
         id_str = "RTX";
         break;
+    case MessageId::SACK:
+        id_str = "SACK";
+        break;
     case MessageId::DONE:
         id_str = "DONE";
         break;
@@ -425,19 +1115,19 @@ void ServerTransaction::PrintRecvLog(const TrftpMessage &msg) const
         break;
     }
 
-    tout << ServerLog() << "recv " << YELLOW << id_str << RESET << " from <" << inet_ntoa(client_address_.sin_addr) << ":"
-         << be16toh(client_address_.sin_port) << "> (xid=" << std::hex << msg.header.xid << std::dec
+    tout << ServerLog() << "recv " << YELLOW << id_str << RESET << " from <" << inet_ntoa(addr.sin_addr) << ":"
+         << be16toh(addr.sin_port) << "> (xid=" << std::hex << msg.header.xid << std::dec
          << ", tpn=" << msg.header.tpn << ", psn=" << msg.header.psn << ", tpl=" << msg.header.tpl
          << ", pl=" << msg.header.pl << ")" << std::endl;
 };
 
-void ServerTransaction::PrintSendLog(const TrftpMessage &msg) const
+void ServerTransaction::PrintSendLog(const TrftpHeader &header, const sockaddr_in &addr) const
 {
     // TODO: DUMP message
 
     std::string id_str = "UNKNOWN";
 
-    switch (MessageId(msg.header.xid))
+    switch (MessageId(header.xid))
     {
     case MessageId::NTF:
         id_str = "NTF";
@@ -448,6 +1138,9 @@ void ServerTransaction::PrintSendLog(const TrftpMessage &msg) const
     case MessageId::DATA:
         id_str = "DATA";
         break;
+    case MessageId::FEC:
+        id_str = "FEC";
+        break;
     case MessageId::FIN:
         id_str = "FIN";
         break;
@@ -458,10 +1151,10 @@ void ServerTransaction::PrintSendLog(const TrftpMessage &msg) const
         break;
     }
 
-    tout << ServerLog() << "send " << YELLOW << id_str << RESET << " to <" << inet_ntoa(client_address_.sin_addr) << ":"
-         << be16toh(client_address_.sin_port) << "> (xid=" << std::hex << msg.header.xid << std::dec
-         << ", tpn=" << msg.header.tpn << ", psn=" << msg.header.psn << ", tpl=" << msg.header.tpl
-         << ", pl=" << msg.header.pl << ")" << std::endl;
+    tout << ServerLog() << "send " << YELLOW << id_str << RESET << " to <" << inet_ntoa(addr.sin_addr) << ":"
+         << be16toh(addr.sin_port) << "> (xid=" << std::hex << header.xid << std::dec
+         << ", tpn=" << header.tpn << ", psn=" << header.psn << ", tpl=" << header.tpl
+         << ", pl=" << header.pl << ")" << std::endl;
 }
 
 } // namespace trftp
\ No newline at end of file
@@ -3,8 +3,42 @@
 namespace trftp
 {
 
-UdpSocket::UdpSocket(std::uint16_t port)
+static constexpr std::size_t GSO_MAX_SEGMENTS = 64;   // UDP_MAX_SEGMENTS of the kernel
+static constexpr std::size_t GSO_MAX_BYTES = 65'507U; // 65535 - IPv4 header - UDP header
+static constexpr std::size_t GRO_MAX_BYTES = 65'535U; // Largest coalesced datagram handed up by the kernel
+static constexpr std::size_t ZEROCOPY_MAX_FRAGS = 17; // MAX_SKB_FRAGS of the kernel
+static constexpr std::size_t PAGE_BYTES = 4'096U;
+static constexpr std::size_t DROPS_CONTROL_BYTES = CMSG_SPACE(sizeof(std::uint32_t)); // SO_RXQ_OVFL counter
+static constexpr std::size_t TIMESTAMP_CONTROL_BYTES = CMSG_SPACE(sizeof(scm_timestamping));
+static constexpr std::size_t ERRQUEUE_CONTROL_BYTES =
+    CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in)) + TIMESTAMP_CONTROL_BYTES;
+static constexpr std::size_t TX_TIMES_MAX = 64;       // Unclaimed TX timestamps kept before they are dropped
+static constexpr auto TX_TIMESTAMP_WAIT = std::chrono::milliseconds(10);
+
+UdpSocket::UdpSocket(std::uint16_t port, bool reuse_port)
     : fd_{ -1 }
+    , segment_offload_{ false }
+    , receive_offload_{ false }
+    , uring_backend_{ false }
+    , drop_accounting_{ false }
+    , rx_drops_{ 0 }
+    , timestamping_{ Timestamping::NONE }
+    , tx_timestamps_{ false }
+    , ring_mutex_{}
+    , ring_{ nullptr }
+    , zerocopy_{ false }
+    , zerocopy_mutex_{}
+    , zerocopy_issued_{ 0 }
+    , zerocopy_completed_{ 0 }
+    , zerocopy_ranges_{}
+    , tx_mutex_{}
+    , tx_times_{}
+    , gro_buffer_{}
+    , gro_len_{ 0 }
+    , gro_offset_{ 0 }
+    , gro_segment_size_{ 0 }
+    , gro_addr_{}
+    , gro_rx_time_{ 0 }
 {
     // Create a socket
     fd_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -31,6 +65,12 @@ UdpSocket::UdpSocket(std::uint16_t port)
         throw std::runtime_error("[UdpSocket] setsockopt(SO_REUSEADDR) failed. err=" + std::to_string(errno));
     }
 
+    // Allow several sockets (receive shards) to bind the same port
+    if (auto reuse = 1; reuse_port && setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0)
+    {
+        throw std::runtime_error("[UdpSocket] setsockopt(SO_REUSEPORT) failed. err=" + std::to_string(errno));
+    }
+
     // Bind local address
     const sockaddr_in my_addr = {
         .sin_family = AF_INET,
@@ -55,6 +95,406 @@ UdpSocket::~UdpSocket()
     }
 }
 
+int UdpSocket::Fd() const
+{
+    return fd_;
+}
+
+bool UdpSocket::SetReusePortSteering(std::uint32_t group_size) const
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    // Pick the socket of the group by the client's IPv4 source address, so every packet of a client flow
+    // lands on the same shard. Sockets are numbered in the order they were bound.
+    sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<std::uint32_t>(SKF_NET_OFF) + offsetof(iphdr, saddr) },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    const sock_fprog prog = { .len = std::size(code), .filter = code };
+
+    if (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool UdpSocket::SetPathMtuProbe(bool enable)
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    // IP_PMTUDISC_PROBE sets DF and ignores the cached path MTU, so oversized datagrams are dropped on the path
+    // instead of being fragmented
+    if (auto mode = enable ? IP_PMTUDISC_PROBE : IP_PMTUDISC_WANT;
+        setsockopt(fd_, IPPROTO_IP, IP_MTU_DISCOVER, &mode, sizeof(mode)) < 0)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool UdpSocket::JoinGroup(const in_addr &group, const in_addr &interface) const
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    // Datagrams to the group are delivered to every socket of the host bound to its port that joined it
+    if (const ip_mreq mreq = { .imr_multiaddr = group, .imr_interface = interface };
+        setsockopt(fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool UdpSocket::SetMulticastInterface(const in_addr &interface) const
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    if (setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool UdpSocket::SetMulticastLoop(bool enable) const
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    // Loops datagrams sent to a group back to the members on this host, e.g. clients on the loopback interface
+    if (auto loop = static_cast<std::uint8_t>(enable);
+        setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+std::uint32_t UdpSocket::PathMtu(const sockaddr_in &addr)
+{
+    // IP_MTU is only reported for a connected socket, so ask the routing table through a throwaway one
+    auto fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    int mtu = 0;
+    socklen_t mtu_len = sizeof(mtu);
+    if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        getsockopt(fd, IPPROTO_IP, IP_MTU, &mtu, &mtu_len) < 0)
+    {
+        mtu = 0;
+    }
+
+    close(fd);
+    return mtu;
+}
+
+bool UdpSocket::SetReceiveBuffer(std::size_t bytes) const
+{
+    return SetBuffer(SO_RCVBUF, SO_RCVBUFFORCE, bytes);
+}
+
+bool UdpSocket::SetSendBuffer(std::size_t bytes) const
+{
+    return SetBuffer(SO_SNDBUF, SO_SNDBUFFORCE, bytes);
+}
+
+bool UdpSocket::SetBuffer(int option, int force_option, std::size_t bytes) const
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    // The *FORCE variant may exceed net.core.[rw]mem_max but needs CAP_NET_ADMIN, the plain one is capped
+    auto size = static_cast<int>(std::min<std::size_t>(bytes, std::numeric_limits<int>::max() / 2));
+    if (setsockopt(fd_, SOL_SOCKET, force_option, &size, sizeof(size)) < 0 &&
+        setsockopt(fd_, SOL_SOCKET, option, &size, sizeof(size)) < 0)
+    {
+        return false;
+    }
+
+    // The kernel doubles the value to account for its bookkeeping overhead
+    int actual = 0;
+    socklen_t actual_len = sizeof(actual);
+    if (getsockopt(fd_, SOL_SOCKET, option, &actual, &actual_len) < 0)
+    {
+        return false;
+    }
+
+    return actual / 2 >= size;
+}
+
+bool UdpSocket::SetDropAccounting(bool enable)
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    if (auto value = enable ? 1 : 0; setsockopt(fd_, SOL_SOCKET, SO_RXQ_OVFL, &value, sizeof(value)) < 0)
+    {
+        return false;
+    }
+
+    drop_accounting_ = enable;
+    return true;
+}
+
+std::uint32_t UdpSocket::ReceiveDrops() const
+{
+    return rx_drops_;
+}
+
+bool UdpSocket::SetTimestamping(Timestamping mode)
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    std::uint32_t flags = 0;
+    switch (mode)
+    {
+    case Timestamping::SOFTWARE:
+        flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        break;
+    case Timestamping::HARDWARE:
+        flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+        break;
+    default:
+        break;
+    }
+
+    // TX timestamps are requested per send and come back on the error queue without the payload, keyed by OPT_ID
+    if (flags != 0)
+    {
+        flags |= SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    }
+
+    std::scoped_lock lock(tx_mutex_);
+    if (setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+    {
+        // SO_TIMESTAMPNS still stamps received packets in software
+        auto enable = (mode == Timestamping::SOFTWARE) ? 1 : 0;
+        if ((mode == Timestamping::HARDWARE) || setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0)
+        {
+            timestamping_ = Timestamping::NONE;
+            tx_timestamps_ = false;
+            return mode == Timestamping::NONE;
+        }
+
+        timestamping_ = mode;
+        tx_timestamps_ = false;
+        return true;
+    }
+
+    timestamping_ = mode;
+    tx_timestamps_ = (flags != 0);
+    return true;
+}
+
+std::size_t UdpSocket::ControlBytes() const
+{
+    return (drop_accounting_ ? DROPS_CONTROL_BYTES : 0) +
+           ((timestamping_ != Timestamping::NONE) ? TIMESTAMP_CONTROL_BYTES : 0);
+}
+
+void UdpSocket::ReadControlMessages(msghdr &hdr, Timestamp *rx_time)
+{
+    for (auto *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET)
+        {
+            continue;
+        }
+
+        if (cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            // The kernel reports its running drop counter only once it is non-zero
+            std::uint32_t drops = 0;
+            std::memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            rx_drops_ = drops;
+        }
+        else if ((cmsg->cmsg_type == SO_TIMESTAMPING) && (rx_time != nullptr))
+        {
+            scm_timestamping stamps;
+            std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            *rx_time = ToTimestamp(stamps);
+        }
+        else if ((cmsg->cmsg_type == SO_TIMESTAMPNS) && (rx_time != nullptr))
+        {
+            timespec ts;
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            *rx_time = std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+        }
+    }
+}
+
+Timestamp UdpSocket::ToTimestamp(const scm_timestamping &stamps) const
+{
+    // ts[0] holds the software timestamp and ts[2] the raw hardware one, ts[1] is deprecated
+    const auto &ts = (timestamping_ == Timestamping::HARDWARE) ? stamps.ts[2] : stamps.ts[0];
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+bool UdpSocket::SetZeroCopy(bool enable)
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    // Kernels before 4.14 do not know SO_ZEROCOPY
+    if (auto value = enable ? 1 : 0; setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) < 0)
+    {
+        zerocopy_ = false;
+        return !enable;
+    }
+
+    zerocopy_ = enable;
+    return true;
+}
+
+std::uint32_t UdpSocket::ZeroCopyTicket() const
+{
+    return zerocopy_issued_;
+}
+
+bool UdpSocket::IsZeroCopyComplete(std::uint32_t ticket) const
+{
+    // Notification IDs are 32 bits wide and wrap around
+    return static_cast<std::int32_t>(zerocopy_completed_ - ticket) >= 0;
+}
+
+bool UdpSocket::WaitZeroCopy(std::uint32_t ticket, std::chrono::microseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!IsZeroCopyComplete(ticket))
+    {
+        if (ReapErrorQueue() > 0)
+        {
+            continue;
+        }
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            return false;
+        }
+
+        // POLLERR is reported while notifications are queued. Another thread (the reactor) may reap them first,
+        // so never sleep for long.
+        pollfd pfd = { .fd = fd_, .events = 0, .revents = 0 };
+        poll(&pfd, 1, 1);
+    }
+
+    return true;
+}
+
+std::size_t UdpSocket::ReapErrorQueue()
+{
+    if ((zerocopy_completed_ == zerocopy_issued_) && !tx_timestamps_)
+    {
+        return 0;
+    }
+
+    std::scoped_lock lock(zerocopy_mutex_);
+
+    std::size_t released = 0;
+    while (true)
+    {
+        alignas(cmsghdr) char control[ERRQUEUE_CONTROL_BYTES] = {};
+        msghdr hdr = {};
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd_, &hdr, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            throw std::runtime_error("[UdpSocket] recvmsg(MSG_ERRQUEUE) failed. err=" + std::to_string(errno));
+        }
+
+        const sock_extended_err *err = nullptr;
+        Timestamp tx_time{ 0 };
+        for (auto *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+        {
+            if ((cmsg->cmsg_level == SOL_IP) && (cmsg->cmsg_type == IP_RECVERR))
+            {
+                err = reinterpret_cast<const sock_extended_err *>(CMSG_DATA(cmsg));
+            }
+            else if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SO_TIMESTAMPING))
+            {
+                scm_timestamping stamps;
+                std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+                tx_time = ToTimestamp(stamps);
+            }
+        }
+
+        if ((err != nullptr) && (err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING))
+        {
+            // Nobody waits for timestamps that arrive much too late, so do not let them pile up
+            if (tx_times_.size() >= TX_TIMES_MAX)
+            {
+                tx_times_.clear();
+            }
+
+            tx_times_[err->ee_data] = tx_time;
+            released++;
+        }
+        else if ((err != nullptr) && (err->ee_origin == SO_EE_ORIGIN_ZEROCOPY))
+        {
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                // The kernel had to copy the pages anyway (e.g. over loopback), which costs more than a plain send
+                zerocopy_ = false;
+            }
+
+            // Each notification releases the inclusive range of IDs [ee_info, ee_data]
+            zerocopy_ranges_[err->ee_info] = err->ee_data;
+            released += err->ee_data - err->ee_info + 1;
+        }
+    }
+
+    for (auto it = zerocopy_ranges_.find(zerocopy_completed_); it != zerocopy_ranges_.end();
+         it = zerocopy_ranges_.find(zerocopy_completed_))
+    {
+        zerocopy_completed_ = it->second + 1;
+        zerocopy_ranges_.erase(it);
+    }
+
+    return released;
+}
+
 bool UdpSocket::SetReadTimeout(std::chrono::microseconds ms) const
 {
     if (fd_ < 0)
@@ -75,10 +515,100 @@ bool UdpSocket::SetReadTimeout(std::chrono::microseconds ms) const
     return true;
 }
 
-std::size_t UdpSocket::Receive(TrftpMessage &msg, sockaddr_in &addr) const
+bool UdpSocket::SetSegmentOffload(bool enable)
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    if (!enable)
+    {
+        segment_offload_ = false;
+        return true;
+    }
+
+    // Probe for kernel support (Linux 4.18+), then clear the socket-wide segment size again.
+    // The segment size is passed per call in SendSegmented() instead.
+    if (int gso_size = sizeof(TrftpMessage); setsockopt(fd_, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) < 0)
+    {
+        segment_offload_ = false;
+        return false;
+    }
+    if (int gso_size = 0; setsockopt(fd_, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) < 0)
+    {
+        segment_offload_ = false;
+        return false;
+    }
+
+    segment_offload_ = true;
+    return true;
+}
+
+bool UdpSocket::SetReceiveOffload(bool enable)
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    // Supported since Linux 5.0
+    if (int gro = enable ? 1 : 0; setsockopt(fd_, SOL_UDP, UDP_GRO, &gro, sizeof(gro)) < 0)
+    {
+        receive_offload_ = false;
+        return false;
+    }
+
+    if (enable && gro_buffer_.empty())
+    {
+        gro_buffer_.resize(GRO_MAX_BYTES);
+    }
+
+    receive_offload_ = enable;
+    return true;
+}
+
+bool UdpSocket::SetIoBackend(IoBackend backend)
 {
-    socklen_t addr_len = sizeof(addr);
-    auto bytes_received = recvfrom(fd_, &msg, sizeof(msg), 0, reinterpret_cast<sockaddr *>(&addr), &addr_len);
+    std::scoped_lock lock(ring_mutex_);
+
+    if (backend == IoBackend::BLOCKING)
+    {
+        uring_backend_ = false;
+        ring_.reset();
+        return true;
+    }
+
+    try
+    {
+        if (!ring_)
+        {
+            ring_ = std::make_unique<IoUring>();
+        }
+    }
+    catch (const std::runtime_error &)
+    {
+        // Not built in or refused by the kernel: keep using the blocking calls
+        return false;
+    }
+
+    uring_backend_ = true;
+    return true;
+}
+
+std::size_t UdpSocket::Receive(TrftpMessage &msg, sockaddr_in &addr, bool wait, Timestamp *rx_time)
+{
+    iovec iov = { .iov_base = &msg, .iov_len = sizeof(msg) };
+    alignas(cmsghdr) char control[DROPS_CONTROL_BYTES + TIMESTAMP_CONTROL_BYTES] = {};
+    msghdr hdr = {};
+    hdr.msg_name = &addr;
+    hdr.msg_namelen = sizeof(addr);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = ControlBytes();
+
+    auto bytes_received = recvmsg(fd_, &hdr, wait ? 0 : MSG_DONTWAIT);
 
     if (bytes_received < 0)
     {
@@ -91,24 +621,241 @@ std::size_t UdpSocket::Receive(TrftpMessage &msg, sockaddr_in &addr) const
             return 0;
         }
 
-        throw std::runtime_error("[UdpSocket] recvfrom() failed. err=" + std::to_string(errno));
+        throw std::runtime_error("[UdpSocket] recvmsg() failed. err=" + std::to_string(errno));
     }
     else if (bytes_received == 0)
     {
-        throw std::runtime_error("[UdpSocket] recvfrom() failed. err=0");
+        throw std::runtime_error("[UdpSocket] recvmsg() failed. err=0");
+    }
+
+    if (rx_time != nullptr)
+    {
+        *rx_time = Timestamp::zero();
     }
+    ReadControlMessages(hdr, rx_time);
 
     return bytes_received;
 }
 
-std::size_t UdpSocket::Send(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr)
+std::size_t UdpSocket::ReceiveBatch(TrftpMessage *msgs, std::size_t *lens, sockaddr_in *addrs, std::size_t count,
+                                    Timestamp *rx_times)
+{
+    if (receive_offload_ || (gro_offset_ < gro_len_))
+    {
+        return ReceiveCoalesced(msgs, lens, addrs, count, rx_times);
+    }
+
+    const auto control_bytes = ControlBytes();
+    std::vector<iovec> iovs(count);
+    std::vector<mmsghdr> hdrs(count);
+    std::vector<std::uint64_t> control((count * control_bytes) / sizeof(std::uint64_t));
+    for (std::size_t i = 0; i < count; i++)
+    {
+        iovs[i] = { .iov_base = &msgs[i], .iov_len = sizeof(TrftpMessage) };
+        hdrs[i] = {};
+        hdrs[i].msg_hdr.msg_name = &addrs[i];
+        hdrs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        hdrs[i].msg_hdr.msg_iov = &iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+        if (!control.empty())
+        {
+            hdrs[i].msg_hdr.msg_control = reinterpret_cast<char *>(control.data()) + i * control_bytes;
+            hdrs[i].msg_hdr.msg_controllen = control_bytes;
+        }
+    }
+
+    if (uring_backend_)
+    {
+        std::scoped_lock lock(ring_mutex_);
+        if (ring_)
+        {
+            if (auto msgs_received = ReceiveIovecsUring(msgs, lens, addrs, hdrs.data(), count, rx_times);
+                msgs_received > 0)
+            {
+                return msgs_received;
+            }
+        }
+    }
+
+    // Block (up to the read timeout) for the first message only, then take whatever else is already queued
+    auto msgs_received = recvmmsg(fd_, hdrs.data(), count, MSG_WAITFORONE, nullptr);
+    if (msgs_received < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return 0;
+        }
+        if (errno == EINTR)
+        {
+            return 0;
+        }
+
+        throw std::runtime_error("[UdpSocket] recvmmsg() failed. err=" + std::to_string(errno));
+    }
+
+    for (auto i = 0; i < msgs_received; i++)
+    {
+        lens[i] = hdrs[i].msg_len;
+        if (rx_times != nullptr)
+        {
+            rx_times[i] = Timestamp::zero();
+        }
+        ReadControlMessages(hdrs[i].msg_hdr, (rx_times != nullptr) ? &rx_times[i] : nullptr);
+    }
+
+    return msgs_received;
+}
+
+std::size_t UdpSocket::ReceiveIovecsUring(TrftpMessage *msgs, std::size_t *lens, sockaddr_in *addrs, mmsghdr *hdrs,
+                                          std::size_t count, Timestamp *rx_times)
+{
+    // Queue one non-blocking RECVMSG per message and submit them with a single io_uring_enter(). The kernel runs them
+    // in order as they are submitted, so the queued datagrams fill the first slots and the rest find none.
+    unsigned queued = 0;
+    while ((queued < count) && ring_->PrepareRecvmsg(fd_, &hdrs[queued].msg_hdr, MSG_DONTWAIT, queued))
+    {
+        queued++;
+    }
+
+    if (!ring_->Submit(queued))
+    {
+        throw std::runtime_error("[UdpSocket] io_uring_enter() failed. err=" + std::to_string(errno));
+    }
+
+    std::vector<std::int32_t> results(queued, -EAGAIN);
+    std::uint64_t user_data = 0;
+    std::int32_t res = 0;
+    for (unsigned reaped = 0; reaped < queued; reaped++)
+    {
+        if (!ring_->PopCompletion(user_data, res))
+        {
+            throw std::runtime_error("[UdpSocket] io_uring completion missing");
+        }
+        if ((res < 0) && (res != -EAGAIN) && (res != -EWOULDBLOCK) && (res != -EINTR))
+        {
+            throw std::runtime_error("[UdpSocket] io_uring recvmsg() failed. err=" + std::to_string(-res));
+        }
+        results[user_data] = res;
+    }
+
+    // Should a datagram have arrived in between, it may leave an empty slot ahead of it
+    std::size_t msgs_received = 0;
+    for (std::size_t i = 0; i < queued; i++)
+    {
+        if (results[i] <= 0)
+        {
+            continue;
+        }
+
+        if (msgs_received != i)
+        {
+            std::memcpy(&msgs[msgs_received], &msgs[i], results[i]);
+            addrs[msgs_received] = addrs[i];
+        }
+        lens[msgs_received] = results[i];
+        if (rx_times != nullptr)
+        {
+            rx_times[msgs_received] = Timestamp::zero();
+        }
+        ReadControlMessages(hdrs[i].msg_hdr, (rx_times != nullptr) ? &rx_times[msgs_received] : nullptr);
+        msgs_received++;
+    }
+
+    return msgs_received;
+}
+
+std::size_t UdpSocket::ReceiveCoalesced(TrftpMessage *msgs, std::size_t *lens, sockaddr_in *addrs, std::size_t count,
+                                        Timestamp *rx_times)
+{
+    std::size_t msgs_received = 0;
+
+    while (msgs_received < count)
+    {
+        // 1. Receive the next (possibly coalesced) datagram once every segment of the last one is handed out
+        if (gro_offset_ >= gro_len_)
+        {
+            if (!receive_offload_)
+            {
+                break;
+            }
+
+            iovec iov = { .iov_base = gro_buffer_.data(), .iov_len = gro_buffer_.size() };
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int)) + DROPS_CONTROL_BYTES + TIMESTAMP_CONTROL_BYTES] = {};
+            msghdr hdr = {};
+            hdr.msg_name = &gro_addr_;
+            hdr.msg_namelen = sizeof(gro_addr_);
+            hdr.msg_iov = &iov;
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = control;
+            hdr.msg_controllen = sizeof(control);
+
+            // Block (up to the read timeout) only while nothing has been received yet
+            auto bytes_received = recvmsg(fd_, &hdr, (msgs_received == 0) ? 0 : MSG_DONTWAIT);
+            if (bytes_received < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    break;
+                }
+
+                throw std::runtime_error("[UdpSocket] recvmsg(UDP_GRO) failed. err=" + std::to_string(errno));
+            }
+
+            gro_len_ = bytes_received;
+            gro_offset_ = 0;
+            gro_segment_size_ = bytes_received;
+            gro_rx_time_ = Timestamp::zero();
+            ReadControlMessages(hdr, &gro_rx_time_);
+
+            for (auto *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+                {
+                    int segment_size = 0;
+                    std::memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+                    if (segment_size > 0)
+                    {
+                        gro_segment_size_ = segment_size;
+                    }
+                }
+            }
+
+            continue;
+        }
+
+        // 2. Split the next segment into its own TrftpMessage slot (truncated like recvfrom() would do)
+        auto segment_len = std::min(gro_segment_size_, gro_len_ - gro_offset_);
+        lens[msgs_received] = std::min(segment_len, sizeof(TrftpMessage));
+        addrs[msgs_received] = gro_addr_;
+        if (rx_times != nullptr)
+        {
+            rx_times[msgs_received] = gro_rx_time_; // Every segment of a coalesced datagram arrived together
+        }
+        std::memcpy(&msgs[msgs_received], &gro_buffer_[gro_offset_], lens[msgs_received]);
+
+        gro_offset_ += segment_len;
+        msgs_received++;
+    }
+
+    return msgs_received;
+}
+
+std::size_t UdpSocket::Send(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr, Timestamp *tx_time)
 {
     if (fd_ < 0)
     {
         throw std::runtime_error("[UdpSocket] socket is closed");
     }
 
-    std::scoped_lock lock(mutex_);
+    if (tx_time != nullptr)
+    {
+        *tx_time = Timestamp::zero();
+        if (tx_timestamps_)
+        {
+            return SendTimestamped(msg, len, addr, *tx_time);
+        }
+    }
+
     auto bytes_sent = sendto(fd_, &msg, len, 0, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
     if (bytes_sent < 0)
     {
@@ -118,4 +865,360 @@ std::size_t UdpSocket::Send(const TrftpMessage &msg, std::size_t len, const sock
     return bytes_sent;
 }
 
+std::size_t UdpSocket::SendTimestamped(const TrftpMessage &msg, std::size_t len, const sockaddr_in &addr,
+                                       Timestamp &tx_time)
+{
+    iovec iov = { .iov_base = const_cast<TrftpMessage *>(&msg), .iov_len = len };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(std::uint32_t))] = {};
+    msghdr hdr = {};
+    hdr.msg_name = const_cast<sockaddr_in *>(&addr);
+    hdr.msg_namelen = sizeof(addr);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    auto *cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SO_TIMESTAMPING;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(std::uint32_t));
+    const std::uint32_t flags =
+        (timestamping_ == Timestamping::HARDWARE) ? SOF_TIMESTAMPING_TX_HARDWARE : SOF_TIMESTAMPING_TX_SOFTWARE;
+    std::memcpy(CMSG_DATA(cmsg), &flags, sizeof(flags));
+
+    // Older kernels advance the OPT_ID key on every send, not only on timestamped ones, so the key cannot be
+    // predicted. Timestamped sends take turns instead, and each one claims the newest timestamp reaped after it.
+    std::scoped_lock tx_lock(tx_mutex_);
+
+    ReapErrorQueue();
+    {
+        std::scoped_lock lock(zerocopy_mutex_);
+        tx_times_.clear();
+    }
+
+    auto bytes_sent = sendmsg(fd_, &hdr, 0);
+    if (bytes_sent < 0)
+    {
+        throw std::runtime_error("[UdpSocket] sendmsg(SO_TIMESTAMPING) failed. err=" + std::to_string(errno));
+    }
+
+    // The timestamp shows up on the error queue once the packet leaves the stack (or the NIC).
+    // Give up after a short while and leave tx_time zero, e.g. when the NIC does not stamp packets.
+    const auto deadline = std::chrono::steady_clock::now() + TX_TIMESTAMP_WAIT;
+    while (true)
+    {
+        ReapErrorQueue();
+        {
+            std::scoped_lock lock(zerocopy_mutex_);
+            auto newest = std::max_element(tx_times_.begin(), tx_times_.end(),
+                                           [](const auto &a, const auto &b) { return a.first < b.first; });
+            if (newest != tx_times_.end())
+            {
+                tx_time = newest->second;
+                tx_times_.clear();
+                break;
+            }
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            break;
+        }
+
+        pollfd pfd = { .fd = fd_, .events = 0, .revents = 0 };
+        poll(&pfd, 1, 1);
+    }
+
+    return bytes_sent;
+}
+
+std::size_t UdpSocket::SendBatch(const TrftpMessage *msgs, const std::size_t *lens, std::size_t count,
+                                 const sockaddr_in &addr)
+{
+    std::vector<iovec> iovs(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        iovs[i] = { .iov_base = const_cast<TrftpMessage *>(&msgs[i]), .iov_len = lens[i] };
+    }
+
+    return SendIovecs(iovs.data(), 1, count, addr);
+}
+
+std::size_t UdpSocket::SendBatch(const TrftpHeader *headers, const std::uint8_t *const *payloads,
+                                 const std::size_t *payload_lens, std::size_t count, const sockaddr_in &addr)
+{
+    std::vector<iovec> iovs(2 * count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        iovs[2 * i] = { .iov_base = const_cast<TrftpHeader *>(&headers[i]), .iov_len = sizeof(TrftpHeader) };
+        iovs[2 * i + 1] = { .iov_base = const_cast<std::uint8_t *>(payloads[i]), .iov_len = payload_lens[i] };
+    }
+
+    return SendIovecs(iovs.data(), 2, count, addr);
+}
+
+std::size_t UdpSocket::SendSegmented(const TrftpMessage *msgs, const std::size_t *lens, std::size_t count,
+                                     const sockaddr_in &addr)
+{
+    std::vector<iovec> iovs(count);
+    std::size_t total_len = 0;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        iovs[i] = { .iov_base = const_cast<TrftpMessage *>(&msgs[i]), .iov_len = lens[i] };
+        total_len += lens[i];
+    }
+
+    return SendSegmentedIovecs(iovs.data(), 1, count, total_len, addr);
+}
+
+std::size_t UdpSocket::SendSegmented(const TrftpHeader *headers, const std::uint8_t *const *payloads,
+                                     const std::size_t *payload_lens, std::size_t count, const sockaddr_in &addr)
+{
+    std::vector<iovec> iovs(2 * count);
+    std::size_t total_len = 0;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        iovs[2 * i] = { .iov_base = const_cast<TrftpHeader *>(&headers[i]), .iov_len = sizeof(TrftpHeader) };
+        iovs[2 * i + 1] = { .iov_base = const_cast<std::uint8_t *>(payloads[i]), .iov_len = payload_lens[i] };
+        total_len += sizeof(TrftpHeader) + payload_lens[i];
+    }
+
+    return SendSegmentedIovecs(iovs.data(), 2, count, total_len, addr);
+}
+
+std::size_t UdpSocket::SendSegmentedIovecs(iovec *iovs, std::size_t iovs_per_msg, std::size_t count,
+                                           std::size_t total_len, const sockaddr_in &addr)
+{
+    // The kernel splits the buffer into equally sized segments, so only the last message may be shorter
+    std::vector<std::size_t> lens(count, 0);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        for (std::size_t j = 0; j < iovs_per_msg; j++)
+        {
+            lens[i] += iovs[i * iovs_per_msg + j].iov_len;
+        }
+    }
+
+    const auto segment_size = (count > 0) ? lens[0] : 0;
+    bool uniform = (count >= 2) && (lens[count - 1] <= segment_size);
+    for (std::size_t i = 1; uniform && (i + 1 < count); i++)
+    {
+        uniform = (lens[i] == segment_size);
+    }
+
+    if (!uniform || !segment_offload_)
+    {
+        return SendIovecs(iovs, iovs_per_msg, count, addr);
+    }
+
+    // A super-buffer is limited to 64 segments and one IPv4 datagram. Zero-copy also pins every iovec as its own
+    // page fragments, and an skb only holds MAX_SKB_FRAGS of them.
+    auto max_segments = std::min(GSO_MAX_SEGMENTS, GSO_MAX_BYTES / segment_size);
+    if (zerocopy_)
+    {
+        max_segments = std::min(max_segments, ZEROCOPY_MAX_FRAGS / (segment_size / PAGE_BYTES + 2 * iovs_per_msg));
+    }
+    if (max_segments < 2)
+    {
+        return SendIovecs(iovs, iovs_per_msg, count, addr);
+    }
+
+    for (std::size_t first = 0; first < count; first += max_segments)
+    {
+        auto segment_count = std::min(max_segments, count - first);
+        auto segment_bytes = segment_count * segment_size;
+        if (first + segment_count == count)
+        {
+            segment_bytes = total_len - first * segment_size;
+        }
+
+        if (!SendSuperBuffer(&iovs[first * iovs_per_msg], segment_count * iovs_per_msg, segment_size, segment_bytes,
+                             addr))
+        {
+            return first + SendIovecs(&iovs[first * iovs_per_msg], iovs_per_msg, count - first, addr);
+        }
+    }
+
+    return count;
+}
+
+std::size_t UdpSocket::SendIovecs(iovec *iovs, std::size_t iovs_per_msg, std::size_t count, const sockaddr_in &addr)
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    // Hand the whole burst to the kernel with as few sendmmsg() calls as possible
+    std::vector<mmsghdr> hdrs(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        hdrs[i] = {};
+        hdrs[i].msg_hdr.msg_name = const_cast<sockaddr_in *>(&addr);
+        hdrs[i].msg_hdr.msg_namelen = sizeof(addr);
+        hdrs[i].msg_hdr.msg_iov = &iovs[i * iovs_per_msg];
+        hdrs[i].msg_hdr.msg_iovlen = iovs_per_msg;
+    }
+
+    if (uring_backend_)
+    {
+        std::scoped_lock lock(ring_mutex_);
+        if (ring_)
+        {
+            return SendIovecsUring(hdrs.data(), count);
+        }
+    }
+
+    // The kernel numbers zero-copy sends in submission order, so they must not interleave with other threads
+    auto flags = 0;
+    std::unique_lock zerocopy_lock(zerocopy_mutex_, std::defer_lock);
+    if (zerocopy_)
+    {
+        zerocopy_lock.lock();
+        flags = MSG_ZEROCOPY;
+    }
+
+    std::size_t msgs_sent = 0;
+    while (msgs_sent < count)
+    {
+        auto ret = sendmmsg(fd_, &hdrs[msgs_sent], count - msgs_sent, flags);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == ENOBUFS && flags == MSG_ZEROCOPY)
+            {
+                // Pending notifications exhausted the socket's option memory, copy the rest of the burst
+                flags = 0;
+                continue;
+            }
+
+            throw std::runtime_error("[UdpSocket] sendmmsg() failed. err=" + std::to_string(errno));
+        }
+
+        if (flags == MSG_ZEROCOPY)
+        {
+            zerocopy_issued_ += ret;
+        }
+        msgs_sent += ret;
+    }
+
+    return msgs_sent;
+}
+
+std::size_t UdpSocket::SendIovecsUring(mmsghdr *hdrs, std::size_t count)
+{
+    // Queue one SENDMSG per message and submit the whole burst with a single io_uring_enter()
+    std::size_t msgs_sent = 0;
+    while (msgs_sent < count)
+    {
+        unsigned queued = 0;
+        while ((msgs_sent + queued < count) && ring_->PrepareSendmsg(fd_, &hdrs[msgs_sent + queued].msg_hdr, 0))
+        {
+            queued++;
+        }
+
+        if (!ring_->Submit(queued))
+        {
+            throw std::runtime_error("[UdpSocket] io_uring_enter() failed. err=" + std::to_string(errno));
+        }
+
+        std::uint64_t user_data = 0;
+        std::int32_t res = 0;
+        for (unsigned reaped = 0; reaped < queued; reaped++)
+        {
+            if (!ring_->PopCompletion(user_data, res))
+            {
+                throw std::runtime_error("[UdpSocket] io_uring completion missing");
+            }
+            if (res < 0)
+            {
+                throw std::runtime_error("[UdpSocket] io_uring sendmsg() failed. err=" + std::to_string(-res));
+            }
+        }
+
+        msgs_sent += queued;
+    }
+
+    return msgs_sent;
+}
+
+bool UdpSocket::SendSuperBuffer(iovec *iovs, std::size_t iov_count, std::size_t segment_size, std::size_t total_len,
+                                const sockaddr_in &addr)
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("[UdpSocket] socket is closed");
+    }
+
+    if (!segment_offload_ || (total_len > GSO_MAX_BYTES) ||
+        ((total_len + segment_size - 1) / segment_size > GSO_MAX_SEGMENTS))
+    {
+        return false;
+    }
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(std::uint16_t))] = {};
+    msghdr hdr = {};
+    hdr.msg_name = const_cast<sockaddr_in *>(&addr);
+    hdr.msg_namelen = sizeof(addr);
+    hdr.msg_iov = iovs;
+    hdr.msg_iovlen = iov_count;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    auto *cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+    *reinterpret_cast<std::uint16_t *>(CMSG_DATA(cmsg)) = segment_size;
+
+    // The kernel numbers zero-copy sends in submission order, so they must not interleave with other threads
+    auto flags = 0;
+    std::unique_lock zerocopy_lock(zerocopy_mutex_, std::defer_lock);
+    if (zerocopy_)
+    {
+        zerocopy_lock.lock();
+        flags = MSG_ZEROCOPY;
+    }
+
+    ssize_t bytes_sent = 0;
+    while ((bytes_sent = sendmsg(fd_, &hdr, flags)) < 0)
+    {
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if ((errno == ENOBUFS || errno == EMSGSIZE) && flags == MSG_ZEROCOPY)
+        {
+            // Pending notifications exhausted the socket's option memory or the buffer needs more page fragments
+            // than an skb holds, copy this super-buffer instead
+            flags = 0;
+            continue;
+        }
+
+        break;
+    }
+
+    if (bytes_sent >= 0 && flags == MSG_ZEROCOPY)
+    {
+        zerocopy_issued_++;
+    }
+
+    if (bytes_sent < 0)
+    {
+        if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+        {
+            // The kernel or the device cannot segment this datagram. Disable GSO and take the normal path.
+            segment_offload_ = false;
+            return false;
+        }
+
+        throw std::runtime_error("[UdpSocket] sendmsg(UDP_SEGMENT) failed. err=" + std::to_string(errno));
+    }
+
+    return true;
+}
+
 } // namespace trftp
\ No newline at end of file
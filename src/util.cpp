@@ -81,6 +81,25 @@ std::uint32_t CalculateFileCrc32(const std::string &download_file)
     return crc32;
 }
 
+void CalculateParity(std::uint8_t *parity, const std::uint8_t *buf, std::size_t size)
+{
+    // XOR a word at a time, the tail byte by byte
+    for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t))
+    {
+        std::uint64_t word, parity_word;
+        std::memcpy(&word, buf, sizeof(word));
+        std::memcpy(&parity_word, parity, sizeof(parity_word));
+        parity_word ^= word;
+        std::memcpy(parity, &parity_word, sizeof(parity_word));
+        buf += sizeof(word);
+        parity += sizeof(word);
+    }
+    while (size--)
+    {
+        *(parity++) ^= *(buf++);
+    }
+}
+
 std::string FtpStatusToString(FtpStatus status)
 {
     std::string status_str = "UNKNOWN";